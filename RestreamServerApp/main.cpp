@@ -4,10 +4,6 @@
 
 #include "Config.h"
 
-extern "C" {
-GST_PLUGIN_STATIC_DECLARE(interpipe);
-}
-
 bool authenticationRequired(GstRTSPMethod method, const std::string& path, bool record)
 {
     const std::string publicPath = "/test";
@@ -28,8 +24,6 @@ int main(int argc, char *argv[])
 {
     gst_init(0, nullptr);
 
-    GST_PLUGIN_STATIC_REGISTER(interpipe);
-
     RestreamServerLib::Callbacks callbacks;
     callbacks.authenticationRequired = authenticationRequired;
 
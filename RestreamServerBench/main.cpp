@@ -0,0 +1,303 @@
+// Fan-out of synthetic H.264 samples to 1, 10 and 100
+// "appsrc ! fakesink" consumers through Channel,
+// and through interpipesink/interpipesrc if gst-interpipe plugin is installed.
+// Producer is kept at most MaxLag samples ahead of the slowest consumer,
+// so nothing is skipped and every consumer gets every sample.
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include "RestreamServerLib/Channel.h"
+
+
+namespace
+{
+
+using RestreamServerLib::Channel;
+
+enum {
+    SamplesCount = 3000,
+    SampleSize = 64 * 1024,
+    KeyframeInterval = 30,
+    MaxLag = 64, // samples, well below Channel::DefaultCapacity
+    Timeout = 60, // seconds
+};
+
+const GstClockTime FrameDuration = GST_SECOND / 30;
+
+const guint8 Payload[SampleSize] = {};
+
+const char* SampleCaps =
+    "video/x-h264,stream-format=byte-stream,alignment=au,"
+    "width=1920,height=1080,framerate=30/1";
+
+struct Consumer
+{
+    Consumer() : pipeline(nullptr), received(0) {}
+    ~Consumer()
+    {
+        if(!pipeline)
+            return;
+
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+
+    GstElement* pipeline;
+    std::atomic<unsigned> received;
+};
+
+typedef std::vector<std::unique_ptr<Consumer> > Consumers;
+
+struct Result
+{
+    bool completed;
+    double seconds;
+    double cpuSeconds;
+};
+
+double CpuTime()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return
+        usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// payload is shared by all samples, so allocation doesn't dominate
+GstSample* MakeSample(GstCaps* caps, unsigned index)
+{
+    GstBuffer* buffer =
+        gst_buffer_new_wrapped_full(
+            GST_MEMORY_FLAG_READONLY,
+            const_cast<guint8*>(Payload), SampleSize,
+            0, SampleSize,
+            nullptr, nullptr);
+    GST_BUFFER_PTS(buffer) = index * FrameDuration;
+    GST_BUFFER_DTS(buffer) = GST_BUFFER_PTS(buffer);
+    GST_BUFFER_DURATION(buffer) = FrameDuration;
+    if(index % KeyframeInterval)
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    GstSample* sample = gst_sample_new(buffer, caps, nullptr, nullptr);
+    gst_buffer_unref(buffer);
+
+    return sample;
+}
+
+// consumer's description should have "sink" element
+Consumer* StartConsumer(
+    const std::string& description,
+    const std::function<void (GstElement* pipeline)>& prepare)
+{
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(description.c_str(), &error);
+    if(error) {
+        fprintf(stderr, "Fail to create consumer: %s\n", error->message);
+        g_error_free(error);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return nullptr;
+    }
+
+    Consumer* consumer = new Consumer;
+    consumer->pipeline = pipeline;
+
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad* pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(
+        pad,
+        GST_PAD_PROBE_TYPE_BUFFER,
+        [] (GstPad*, GstPadProbeInfo*, gpointer userData) -> GstPadProbeReturn {
+            ++static_cast<Consumer*>(userData)->received;
+            return GST_PAD_PROBE_OK;
+        },
+        consumer, nullptr);
+    gst_object_unref(pad);
+    gst_object_unref(sink);
+
+    if(prepare)
+        prepare(pipeline);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    return consumer;
+}
+
+unsigned MinReceived(const Consumers& consumers)
+{
+    unsigned minReceived = SamplesCount;
+    for(const auto& consumer: consumers)
+        minReceived = std::min<unsigned>(minReceived, consumer->received);
+
+    return minReceived;
+}
+
+Result Produce(
+    const std::function<void (GstSample*)>& push,
+    const Consumers& consumers)
+{
+    GstCaps* caps = gst_caps_from_string(SampleCaps);
+
+    const double cpuStart = CpuTime();
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::seconds(Timeout);
+
+    bool completed = true;
+    for(unsigned i = 0; i < SamplesCount && completed; ++i) {
+        while(i > MinReceived(consumers) + MaxLag) {
+            if(std::chrono::steady_clock::now() > deadline) {
+                completed = false;
+                break;
+            }
+            g_usleep(50);
+        }
+
+        push(MakeSample(caps, i));
+    }
+
+    while(completed && MinReceived(consumers) < SamplesCount) {
+        if(std::chrono::steady_clock::now() > deadline)
+            completed = false;
+        g_usleep(50);
+    }
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    gst_caps_unref(caps);
+
+    return Result { completed, elapsed.count(), CpuTime() - cpuStart };
+}
+
+Result BenchChannel(unsigned listeners)
+{
+    std::shared_ptr<Channel> channel = std::make_shared<Channel>();
+
+    Consumers consumers;
+    for(unsigned i = 0; i < listeners; ++i) {
+        Consumer* consumer =
+            StartConsumer(
+                "appsrc name=src ! fakesink name=sink sync=false async=false",
+                [&channel] (GstElement* pipeline) {
+                    GstElement* appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+                    Channel::attachAppSrc(channel, appsrc);
+                    gst_object_unref(appsrc);
+                });
+        if(!consumer)
+            return Result { false, 0, 0 };
+        consumers.emplace_back(consumer);
+    }
+
+    return
+        Produce(
+            [&channel] (GstSample* sample) {
+                channel->push(sample);
+            },
+            consumers);
+}
+
+Result BenchInterpipe(unsigned listeners)
+{
+    const std::string sinkName = "bench" + std::to_string(listeners);
+
+    GstElement* producer =
+        gst_parse_launch(
+            ("appsrc name=src is-live=true format=time ! "
+             "interpipesink name=" + sinkName + " sync=false async=false").c_str(),
+            nullptr);
+    if(!producer)
+        return Result { false, 0, 0 };
+
+    GstElement* appsrc = gst_bin_get_by_name(GST_BIN(producer), "src");
+    GstCaps* caps = gst_caps_from_string(SampleCaps);
+    g_object_set(appsrc, "caps", caps, "max-bytes", G_GUINT64_CONSTANT(0), NULL);
+    gst_caps_unref(caps);
+    gst_element_set_state(producer, GST_STATE_PLAYING);
+
+    Consumers consumers;
+    for(unsigned i = 0; i < listeners; ++i) {
+        Consumer* consumer =
+            StartConsumer(
+                "interpipesrc listen-to=" + sinkName + " is-live=true format=time ! "
+                "fakesink name=sink sync=false async=false",
+                nullptr);
+        if(!consumer)
+            break;
+        consumers.emplace_back(consumer);
+    }
+
+    Result result = { false, 0, 0 };
+    if(consumers.size() == listeners) {
+        result =
+            Produce(
+                [appsrc] (GstSample* sample) {
+                    gst_app_src_push_sample(GST_APP_SRC(appsrc), sample);
+                    gst_sample_unref(sample);
+                },
+                consumers);
+    }
+
+    consumers.clear();
+
+    gst_object_unref(appsrc);
+    gst_element_set_state(producer, GST_STATE_NULL);
+    gst_object_unref(producer);
+
+    return result;
+}
+
+void Print(const char* transport, unsigned listeners, const Result& result)
+{
+    if(!result.completed) {
+        printf("%-10s %9u %12s\n", transport, listeners, "stalled");
+        return;
+    }
+
+    printf(
+        "%-10s %9u %12.0f %14.0f %7.0f%%\n",
+        transport, listeners,
+        SamplesCount / result.seconds,
+        SamplesCount * listeners / result.seconds,
+        100 * result.cpuSeconds / result.seconds);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+
+    GstElementFactory* interpipeFactory = gst_element_factory_find("interpipesink");
+    const bool interpipeAvailable = interpipeFactory != nullptr;
+    if(interpipeFactory)
+        gst_object_unref(interpipeFactory);
+    else
+        fprintf(stderr, "gst-interpipe plugin is not found, only Channel is measured\n");
+
+    printf(
+        "%u samples of %u bytes\n%-10s %9s %12s %14s %8s\n",
+        static_cast<unsigned>(SamplesCount), static_cast<unsigned>(SampleSize),
+        "transport", "listeners", "samples/s", "delivered/s", "cpu");
+
+    for(unsigned listeners: { 1, 10, 100 }) {
+        Print("channel", listeners, BenchChannel(listeners));
+        if(interpipeAvailable)
+            Print("interpipe", listeners, BenchInterpipe(listeners));
+    }
+
+    return 0;
+}
@@ -0,0 +1,694 @@
+#include "Channel.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include <CxxPtr/GlibPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+const gchar* AppSrcListenerKey = "restream-appsrc-listener";
+
+// listener notified by current thread,
+// notify of one channel could push to another one
+thread_local const void* NotifyingListener = nullptr;
+
+bool IsKeyframe(GstSample* sample)
+{
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    return buffer && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+// Feeds appsrc from channel.
+// Samples are pulled when appsrc needs data or when channel notifies
+// about new sample, whatever thread comes first does the work.
+struct AppSrcListener
+{
+    AppSrcListener(
+        const std::shared_ptr<Channel>&,
+        GstElement* appsrc,
+        const std::function<void (GstCaps*)>& capsChanged);
+    ~AppSrcListener();
+
+    void listen();
+    void drain();
+    void doDrain(GstAppSrc*);
+    void switchChannel();
+    void push(GstAppSrc*, GstSample*);
+
+    // accessed from draining thread only
+    std::shared_ptr<Channel> channel;
+    Channel::ListenerId id;
+    GWeakRef appsrc;
+    const std::function<void (GstCaps*)> capsChanged;
+
+    std::mutex pendingChannelMutex;
+    std::shared_ptr<Channel> pendingChannel;
+
+    std::atomic<bool> needData;
+    std::atomic<unsigned> drainRequests;
+
+    GstCaps* caps;
+    bool timeOffsetValid;
+    GstClockTimeDiff timeOffset;
+};
+
+AppSrcListener::AppSrcListener(
+    const std::shared_ptr<Channel>& channel,
+    GstElement* appsrc,
+    const std::function<void (GstCaps*)>& capsChanged) :
+    channel(channel), id(Channel::InvalidListener),
+    capsChanged(capsChanged),
+    needData(false), drainRequests(0),
+    caps(nullptr), timeOffsetValid(false), timeOffset(0)
+{
+    g_weak_ref_init(&this->appsrc, appsrc);
+}
+
+AppSrcListener::~AppSrcListener()
+{
+    if(id != Channel::InvalidListener)
+        channel->removeListener(id);
+
+    g_weak_ref_clear(&appsrc);
+
+    if(caps)
+        gst_caps_unref(caps);
+}
+
+void AppSrcListener::listen()
+{
+    id = channel->addListener(std::bind(&AppSrcListener::drain, this));
+}
+
+void AppSrcListener::drain()
+{
+    if(drainRequests.fetch_add(1) > 0)
+        return; // thread already draining will do the work
+
+    GstElement* element = GST_ELEMENT(g_weak_ref_get(&appsrc));
+
+    unsigned handled = 1;
+    do {
+        if(element)
+            doDrain(GST_APP_SRC(element));
+        handled = drainRequests.fetch_sub(handled) - handled;
+    } while(handled != 0);
+
+    if(element)
+        gst_object_unref(element);
+}
+
+void AppSrcListener::switchChannel()
+{
+    std::shared_ptr<Channel> newChannel;
+    {
+        std::lock_guard<std::mutex> lock(pendingChannelMutex);
+        newChannel.swap(pendingChannel);
+    }
+
+    if(!newChannel || newChannel == channel)
+        return;
+
+    // it's usually called from old channel's notification,
+    // so listener removal could be deferred until notify returns
+    channel->removeListener(id);
+    channel = newChannel;
+    timeOffsetValid = false;
+    listen();
+}
+
+void AppSrcListener::doDrain(GstAppSrc* appsrc)
+{
+    switchChannel();
+
+    while(needData.load()) {
+        GstSample* sample = channel->pull(id);
+        if(!sample)
+            break;
+
+        push(appsrc, sample);
+
+        gst_sample_unref(sample);
+    }
+}
+
+// timestamps are kept as is if both pipelines share clock and base time,
+// otherwise translated from producer's running time to appsrc's one
+void AppSrcListener::push(GstAppSrc* appsrc, GstSample* sample)
+{
+    GstCaps* sampleCaps = gst_sample_get_caps(sample);
+    if(sampleCaps && (!caps || !gst_caps_is_equal(caps, sampleCaps))) {
+        // downstream (and players' decoders) could switch to new
+        // stream parameters only at IDR carrying new SPS/PPS,
+        // so units preceding it are dropped
+        if(caps && !IsKeyframe(sample)) {
+            channel->requestKeyframe();
+            return;
+        }
+
+        GCharPtr capsStringPtr(gst_caps_to_string(sampleCaps));
+        Log()->debug("AppSrcListener. Caps changed: {}", capsStringPtr.get());
+
+        gst_caps_replace(&caps, sampleCaps);
+        gst_app_src_set_caps(appsrc, caps);
+
+        if(capsChanged)
+            capsChanged(caps);
+    }
+
+    GstBuffer* sampleBuffer = gst_sample_get_buffer(sample);
+    if(!sampleBuffer)
+        return;
+
+    // buffer memory is shared, not copied
+    GstBuffer* buffer = gst_buffer_copy(sampleBuffer);
+
+    GstClockTime runningTime = GST_CLOCK_TIME_NONE;
+    bool sharedTime = false;
+    GstClock* clock = gst_element_get_clock(GST_ELEMENT(appsrc));
+    if(clock) {
+        const GstClockTime baseTime = gst_element_get_base_time(GST_ELEMENT(appsrc));
+        runningTime = gst_clock_get_time(clock) - baseTime;
+        sharedTime =
+            clock == Private::SharedClock() &&
+            baseTime == Private::SharedBaseTime();
+        gst_object_unref(clock);
+    }
+
+    const GstSegment* segment = gst_sample_get_segment(sample);
+    if(sharedTime && segment && segment->format == GST_FORMAT_TIME) {
+        // producer's running time is appsrc's running time too
+        const GstClockTime pts =
+            gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+        const GstClockTime dts =
+            gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_DTS(buffer));
+        GST_BUFFER_PTS(buffer) = pts;
+        GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_IS_VALID(dts) ? dts : pts;
+    } else if(GST_CLOCK_TIME_IS_VALID(runningTime) &&
+              GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+    {
+        const GstClockTime pts = GST_BUFFER_PTS(buffer);
+        const GstClockTimeDiff shiftedPts = GstClockTimeDiff(pts) + timeOffset;
+
+        // producer was restarted or listener was lagging too much
+        if(!timeOffsetValid ||
+           std::abs(GstClockTimeDiff(runningTime) - shiftedPts) > GstClockTimeDiff(GST_SECOND))
+        {
+            timeOffset = GstClockTimeDiff(runningTime) - GstClockTimeDiff(pts);
+            timeOffsetValid = true;
+        }
+
+        GST_BUFFER_PTS(buffer) =
+            std::max<GstClockTimeDiff>(GstClockTimeDiff(pts) + timeOffset, 0);
+        const GstClockTime dts = GST_BUFFER_DTS(buffer);
+        if(GST_CLOCK_TIME_IS_VALID(dts)) {
+            GST_BUFFER_DTS(buffer) =
+                std::max<GstClockTimeDiff>(GstClockTimeDiff(dts) + timeOffset, 0);
+        }
+    } else {
+        // appsrc will timestamp it with do-timestamp
+        GST_BUFFER_PTS(buffer) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+    }
+
+    gst_app_src_push_buffer(appsrc, buffer);
+}
+
+}
+
+
+Channel::Channel(unsigned capacity) :
+    _capacity(capacity),
+    _slots(new Slot[capacity]),
+    _head(0), _lastKeyframe(0),
+    _lastKeyframeTime(0), _lastKeyframeRequestTime(0),
+    _maxKeyframeAge(0), _minKeyframeRequestInterval(DefaultKeyframeRequestInterval),
+    _bitrateWindowBytes(0), _bitrateWindowStart(0), _ingestBitrate(0),
+    _lastBitrateUpdateTime(0), _recommendedBitrate(0),
+    _caps(nullptr),
+    _listenersEnd(0)
+{
+    assert(capacity > 4);
+
+    for(unsigned i = 0; i < _capacity; ++i) {
+        _slots[i].seq.store(0);
+        _slots[i].sample.store(nullptr);
+    }
+
+    for(Listener& listener: _listeners) {
+        listener.used.store(false);
+        listener.active.store(false);
+        listener.waiting.store(false);
+        listener.notifying.store(false);
+        listener.removePending.store(false);
+        listener.hazard.store(nullptr);
+        listener.cursor = 0;
+        listener.waitKeyframe = false;
+    }
+}
+
+Channel::~Channel()
+{
+    for(unsigned i = 0; i < _capacity; ++i) {
+        GstSample* sample = _slots[i].sample.load();
+        if(sample)
+            gst_sample_unref(sample);
+    }
+
+    for(GstSample* sample: _retired)
+        gst_sample_unref(sample);
+
+    if(_caps)
+        gst_caps_unref(_caps);
+}
+
+bool Channel::isHazard(GstSample* sample) const
+{
+    const unsigned end = _listenersEnd.load();
+    for(unsigned i = 0; i < end; ++i) {
+        if(_listeners[i].hazard.load() == sample)
+            return true;
+    }
+
+    return false;
+}
+
+void Channel::retire(GstSample* sample)
+{
+    for(auto it = _retired.begin(); it != _retired.end();) {
+        if(isHazard(*it))
+            ++it;
+        else {
+            gst_sample_unref(*it);
+            it = _retired.erase(it);
+        }
+    }
+
+    if(isHazard(sample))
+        _retired.push_back(sample);
+    else
+        gst_sample_unref(sample);
+}
+
+void Channel::push(GstSample* sample)
+{
+    const uint64_t seq = _head.load() + 1;
+
+    Slot& slot = _slots[seq % _capacity];
+    slot.seq.store(0);
+    GstSample* replaced = slot.sample.exchange(sample);
+    slot.seq.store(seq);
+
+    const gint64 now = g_get_monotonic_time();
+
+    GstCaps* sampleCaps = gst_sample_get_caps(sample);
+    if(sampleCaps && sampleCaps != _caps) {
+        std::lock_guard<std::mutex> lock(_capsMutex);
+        gst_caps_replace(&_caps, sampleCaps);
+    }
+
+    if(IsKeyframe(sample)) {
+        _lastKeyframe.store(seq);
+        _lastKeyframeTime.store(now);
+    }
+
+    if(GstBuffer* buffer = gst_sample_get_buffer(sample)) {
+        // only producer thread writes bitrate window
+        const uint64_t windowBytes =
+            _bitrateWindowBytes.load() + gst_buffer_get_size(buffer);
+        const gint64 windowDuration = now - _bitrateWindowStart.load();
+        if(windowDuration >= G_USEC_PER_SEC) {
+            _ingestBitrate.store(windowBytes * 8 * G_USEC_PER_SEC / windowDuration);
+            _bitrateWindowBytes.store(0);
+            _bitrateWindowStart.store(now);
+        } else
+            _bitrateWindowBytes.store(windowBytes);
+    }
+
+    _head.store(seq);
+
+    if(replaced)
+        retire(replaced);
+
+    const unsigned end = _listenersEnd.load();
+    for(unsigned i = 0; i < end; ++i) {
+        Listener& listener = _listeners[i];
+        if(!listener.active.load() || !listener.waiting.exchange(false))
+            continue;
+
+        listener.notifying.store(true);
+        const void* outerNotifyingListener = NotifyingListener;
+        NotifyingListener = &listener;
+        if(listener.active.load())
+            listener.notify();
+        NotifyingListener = outerNotifyingListener;
+        if(listener.removePending.exchange(false))
+            releaseListener(listener);
+        listener.notifying.store(false);
+    }
+}
+
+// position of the latest keyframe still available in the ring
+uint64_t Channel::joinPosition() const
+{
+    const uint64_t head = _head.load();
+    const uint64_t keyframe = _lastKeyframe.load();
+    const uint64_t lagLimit = _capacity - _capacity / 4;
+
+    if(keyframe > 0 && head - keyframe < lagLimit)
+        return keyframe;
+
+    return head + 1;
+}
+
+Channel::ListenerId Channel::addListener(const std::function<void ()>& notify)
+{
+    for(unsigned i = 0; i < MaxListeners; ++i) {
+        Listener& listener = _listeners[i];
+        if(listener.used.exchange(true))
+            continue;
+
+        listener.waiting.store(false);
+        listener.hazard.store(nullptr);
+        listener.cursor = joinPosition();
+        listener.waitKeyframe = true;
+        listener.notify = notify;
+
+        unsigned end = _listenersEnd.load();
+        while(end < i + 1 && !_listenersEnd.compare_exchange_weak(end, i + 1));
+
+        listener.active.store(true);
+
+        return i;
+    }
+
+    Log()->error("Channel. Max listeners count reached");
+
+    return InvalidListener;
+}
+
+void Channel::removeListener(ListenerId id)
+{
+    if(id >= MaxListeners)
+        return;
+
+    Listener& listener = _listeners[id];
+
+    listener.active.store(false);
+
+    // notify being executed can't be destroyed,
+    // and waiting for it from itself would never end
+    if(NotifyingListener == &listener) {
+        listener.removePending.store(true);
+        return;
+    }
+
+    while(listener.notifying.load())
+        std::this_thread::yield();
+
+    releaseListener(listener);
+}
+
+void Channel::releaseListener(Listener& listener)
+{
+    listener.notify = nullptr;
+    listener.hazard.store(nullptr);
+    listener.used.store(false);
+}
+
+GstSample* Channel::pull(ListenerId id)
+{
+    if(id >= MaxListeners)
+        return nullptr;
+
+    Listener& listener = _listeners[id];
+
+    const uint64_t lagLimit = _capacity - _capacity / 4;
+
+    for(;;) {
+        const uint64_t head = _head.load();
+        if(listener.cursor > head) {
+            listener.waiting.store(true);
+            // recheck to not miss notification about just pushed sample
+            if(_head.load() < listener.cursor)
+                return nullptr;
+            listener.waiting.store(false);
+            continue;
+        }
+
+        if(head - listener.cursor >= lagLimit) {
+            const uint64_t cursor = joinPosition();
+            Log()->debug(
+                "Channel. Lagging listener skipped {} samples",
+                cursor - listener.cursor);
+            listener.cursor = cursor;
+            listener.waitKeyframe = true;
+            continue;
+        }
+
+        Slot& slot = _slots[listener.cursor % _capacity];
+
+        GstSample* sample = slot.sample.load();
+        listener.hazard.store(sample);
+        if(slot.sample.load() != sample || slot.seq.load() != listener.cursor) {
+            // slot is being overwritten
+            listener.hazard.store(nullptr);
+            continue;
+        }
+
+        ++listener.cursor;
+
+        if(listener.waitKeyframe && !IsKeyframe(sample)) {
+            listener.hazard.store(nullptr);
+            requestKeyframe();
+            continue;
+        }
+        listener.waitKeyframe = false;
+
+        gst_sample_ref(sample);
+        listener.hazard.store(nullptr);
+
+        return sample;
+    }
+}
+
+void Channel::setKeyframeRequestHandler(const std::function<void ()>& handler)
+{
+    std::lock_guard<std::mutex> lock(_keyframeRequestMutex);
+
+    _keyframeRequestHandler = handler;
+}
+
+void Channel::setKeyframePolicy(
+    unsigned maxKeyframeAge,
+    unsigned minRequestInterval)
+{
+    _maxKeyframeAge.store(maxKeyframeAge);
+    _minKeyframeRequestInterval.store(minRequestInterval);
+}
+
+void Channel::requestKeyframe()
+{
+    const gint64 maxKeyframeAge = _maxKeyframeAge.load() * G_GINT64_CONSTANT(1000);
+    if(0 == maxKeyframeAge)
+        return;
+
+    const gint64 now = g_get_monotonic_time();
+    if(now - _lastKeyframeTime.load() < maxKeyframeAge)
+        return;
+
+    const gint64 minRequestInterval =
+        _minKeyframeRequestInterval.load() * G_GINT64_CONSTANT(1000);
+    gint64 lastRequestTime = _lastKeyframeRequestTime.load();
+    if(now - lastRequestTime < minRequestInterval)
+        return;
+
+    // only one of concurrent requests wins
+    if(!_lastKeyframeRequestTime.compare_exchange_strong(lastRequestTime, now))
+        return;
+
+    std::lock_guard<std::mutex> lock(_keyframeRequestMutex);
+
+    if(_keyframeRequestHandler) {
+        Log()->debug("Channel. Requesting keyframe");
+        _keyframeRequestHandler();
+    }
+}
+
+// multiplicative decrease while most of viewers are congested
+// and additive increase until recommendation isn't limiting anymore
+void Channel::reportViewersHealth(
+    const void* reporter,
+    unsigned viewers,
+    unsigned congestedViewers)
+{
+    std::lock_guard<std::mutex> lock(_viewersHealthMutex);
+
+    _viewersHealth[reporter] = ViewersHealth { viewers, congestedViewers };
+
+    const gint64 now = g_get_monotonic_time();
+    if(now - _lastBitrateUpdateTime < G_USEC_PER_SEC)
+        return;
+    _lastBitrateUpdateTime = now;
+
+    unsigned totalViewers = 0;
+    unsigned totalCongested = 0;
+    for(const auto& pair: _viewersHealth) {
+        totalViewers += pair.second.viewers;
+        totalCongested += pair.second.congestedViewers;
+    }
+
+    const unsigned ingestBitrate = _ingestBitrate.load();
+    const unsigned recommendedBitrate = _recommendedBitrate.load();
+    if(ingestBitrate == 0)
+        return;
+
+    if(totalViewers > 0 && totalCongested * 2 > totalViewers) {
+        const unsigned bitrate =
+            recommendedBitrate ?
+                std::min(recommendedBitrate, ingestBitrate) :
+                ingestBitrate;
+        _recommendedBitrate.store(bitrate / 100 * 85);
+
+        Log()->info(
+            "Channel. Viewers congested. viewers: {}, congested: {}, recommended bitrate: {}",
+            totalViewers, totalCongested, _recommendedBitrate.load());
+    } else if(recommendedBitrate) {
+        const unsigned bitrate = recommendedBitrate + recommendedBitrate / 20;
+        if(bitrate > ingestBitrate + ingestBitrate / 2) {
+            Log()->info("Channel. Viewers recovered. Dropping bitrate recommendation");
+            _recommendedBitrate.store(0);
+        } else
+            _recommendedBitrate.store(bitrate);
+    }
+}
+
+void Channel::removeViewersHealth(const void* reporter)
+{
+    std::lock_guard<std::mutex> lock(_viewersHealthMutex);
+
+    _viewersHealth.erase(reporter);
+}
+
+unsigned Channel::recommendedBitrate() const
+{
+    return _recommendedBitrate.load();
+}
+
+unsigned Channel::ingestBitrate() const
+{
+    return _ingestBitrate.load();
+}
+
+GstCaps* Channel::caps() const
+{
+    std::lock_guard<std::mutex> lock(_capsMutex);
+
+    return _caps ? gst_caps_ref(_caps) : nullptr;
+}
+
+void Channel::attachAppSink(
+    const std::shared_ptr<Channel>& channel,
+    GstElement* appsink)
+{
+    g_object_set(appsink,
+        "sync", FALSE,
+        "async", FALSE,
+        "emit-signals", FALSE,
+        NULL);
+
+    GstAppSinkCallbacks callbacks = {};
+    callbacks.new_sample =
+        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn {
+            Channel* channel =
+                static_cast<std::shared_ptr<Channel>*>(userData)->get();
+
+            GstSample* sample = gst_app_sink_pull_sample(appsink);
+            if(sample)
+                channel->push(sample);
+
+            return GST_FLOW_OK;
+        };
+
+    gst_app_sink_set_callbacks(
+        GST_APP_SINK(appsink),
+        &callbacks,
+        new std::shared_ptr<Channel>(channel),
+        [] (gpointer userData) {
+            delete static_cast<std::shared_ptr<Channel>*>(userData);
+        });
+}
+
+void Channel::attachAppSrc(
+    const std::shared_ptr<Channel>& channel,
+    GstElement* appsrc,
+    const std::function<void (GstCaps*)>& capsChanged)
+{
+    g_object_set(appsrc,
+        "is-live", TRUE,
+        "format", GST_FORMAT_TIME,
+        "do-timestamp", TRUE,
+        "min-latency", G_GINT64_CONSTANT(0),
+        NULL);
+
+    AppSrcListener* listener = new AppSrcListener(channel, appsrc, capsChanged);
+    listener->listen();
+    // listener lives while appsrc keeps callbacks
+    g_object_set_data(G_OBJECT(appsrc), AppSrcListenerKey, listener);
+
+    GstAppSrcCallbacks callbacks = {};
+    callbacks.need_data =
+        [] (GstAppSrc* /*appsrc*/, guint /*length*/, gpointer userData) {
+            AppSrcListener* listener = static_cast<AppSrcListener*>(userData);
+            listener->needData.store(true);
+            listener->drain();
+        };
+    callbacks.enough_data =
+        [] (GstAppSrc* /*appsrc*/, gpointer userData) {
+            AppSrcListener* listener = static_cast<AppSrcListener*>(userData);
+            listener->needData.store(false);
+        };
+
+    gst_app_src_set_callbacks(
+        GST_APP_SRC(appsrc),
+        &callbacks,
+        listener,
+        [] (gpointer userData) {
+            delete static_cast<AppSrcListener*>(userData);
+        });
+}
+
+void Channel::reattachAppSrc(
+    const std::shared_ptr<Channel>& channel,
+    GstElement* appsrc)
+{
+    AppSrcListener* listener =
+        static_cast<AppSrcListener*>(g_object_get_data(G_OBJECT(appsrc), AppSrcListenerKey));
+    if(!listener) {
+        attachAppSrc(channel, appsrc);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(listener->pendingChannelMutex);
+        listener->pendingChannel = channel;
+    }
+
+    listener->drain();
+}
+
+}
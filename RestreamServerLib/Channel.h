@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <vector>
+#include <functional>
+
+#include <gst/gst.h>
+
+
+namespace RestreamServerLib
+{
+
+// Single producer/multiple consumers broadcast of encoded samples.
+// Samples are kept in ring of refcounted GstSample without copying,
+// every listener has it's own cursor in the ring,
+// lagging listener skips to the latest keyframe.
+// Neither push nor pull take locks.
+class Channel : public std::enable_shared_from_this<Channel>
+{
+public:
+    typedef unsigned ListenerId;
+    static const ListenerId InvalidListener = ~0u;
+
+    enum {
+        DefaultCapacity = 256,
+        MaxListeners = 128,
+        DefaultKeyframeRequestInterval = 1000, // ms
+    };
+
+    Channel(unsigned capacity = DefaultCapacity);
+    ~Channel();
+
+    // takes ownership of sample,
+    // must be called from one thread at a time
+    void push(GstSample*);
+
+    // notify is called from producer's thread
+    // when new sample is available for listener waiting for it
+    ListenerId addListener(const std::function<void ()>& notify);
+    // could be called from listener's own notify,
+    // then removal is completed when notify returns
+    void removeListener(ListenerId);
+
+    // returns referenced sample or nullptr if there are no new samples,
+    // in latter case listener will be notified on next push,
+    // must be called from one thread at a time for every listener
+    GstSample* pull(ListenerId);
+
+    // handler is called when keyframe is needed and should ask
+    // producer's source for it, it's called with internal lock held
+    void setKeyframeRequestHandler(const std::function<void ()>&);
+    // keyframe is requested only if the latest one is older than maxKeyframeAge
+    // and not more often than once per minRequestInterval,
+    // 0 maxKeyframeAge disables requests
+    void setKeyframePolicy(
+        unsigned maxKeyframeAge, // ms
+        unsigned minRequestInterval = DefaultKeyframeRequestInterval); // ms
+    // could be called from any thread
+    void requestKeyframe();
+
+    // viewers health of one of channel's consumers,
+    // reports are aggregated to bitrate recommendation for producer
+    void reportViewersHealth(
+        const void* reporter,
+        unsigned viewers,
+        unsigned congestedViewers);
+    void removeViewersHealth(const void* reporter);
+    // bits per second, 0 if there is no recommendation
+    unsigned recommendedBitrate() const;
+    // bits per second measured on producer's side
+    unsigned ingestBitrate() const;
+
+    // referenced caps of the latest sample or nullptr if there were no samples,
+    // could be called from any thread
+    GstCaps* caps() const;
+
+    // makes appsink push samples to channel while element is alive
+    static void attachAppSink(
+        const std::shared_ptr<Channel>&,
+        GstElement* appsink);
+    // makes appsrc pull samples from channel while element is alive,
+    // capsChanged is called with new caps set on appsrc
+    // from the thread pushing to appsrc
+    static void attachAppSrc(
+        const std::shared_ptr<Channel>&,
+        GstElement* appsrc,
+        const std::function<void (GstCaps*)>& capsChanged = nullptr);
+    // makes appsrc attached to other channel pull samples from this one,
+    // switch happens on the next drain, starting from the latest keyframe
+    static void reattachAppSrc(
+        const std::shared_ptr<Channel>&,
+        GstElement* appsrc);
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> seq; // 0 if slot is empty or being written
+        std::atomic<GstSample*> sample;
+    };
+
+    struct Listener
+    {
+        std::atomic<bool> used;
+        std::atomic<bool> active;
+        std::atomic<bool> waiting;
+        std::atomic<bool> notifying;
+        std::atomic<bool> removePending; // removed from own notify
+        std::atomic<GstSample*> hazard; // sample being referenced by listener
+
+        uint64_t cursor;
+        bool waitKeyframe;
+        std::function<void ()> notify;
+    };
+
+    void releaseListener(Listener&);
+    bool isHazard(GstSample*) const;
+    void retire(GstSample*);
+    uint64_t joinPosition() const;
+
+private:
+    const unsigned _capacity;
+    std::unique_ptr<Slot[]> _slots;
+
+    std::atomic<uint64_t> _head; // seq of last pushed sample
+    std::atomic<uint64_t> _lastKeyframe;
+
+    std::atomic<gint64> _lastKeyframeTime; // monotonic, us
+    std::atomic<gint64> _lastKeyframeRequestTime; // monotonic, us
+    std::atomic<unsigned> _maxKeyframeAge;
+    std::atomic<unsigned> _minKeyframeRequestInterval;
+    std::mutex _keyframeRequestMutex;
+    std::function<void ()> _keyframeRequestHandler;
+
+    std::atomic<uint64_t> _bitrateWindowBytes;
+    std::atomic<gint64> _bitrateWindowStart; // monotonic, us
+    std::atomic<unsigned> _ingestBitrate; // bits per second
+
+    struct ViewersHealth
+    {
+        unsigned viewers;
+        unsigned congestedViewers;
+    };
+    std::mutex _viewersHealthMutex;
+    std::map<const void*, ViewersHealth> _viewersHealth;
+    gint64 _lastBitrateUpdateTime; // monotonic, us
+    std::atomic<unsigned> _recommendedBitrate;
+
+    // written by producer only, so it's read there without lock
+    mutable std::mutex _capsMutex;
+    GstCaps* _caps;
+
+    Listener _listeners[MaxListeners];
+    std::atomic<unsigned> _listenersEnd; // upper bound of used listeners
+
+    // samples replaced in ring but still referenced by listeners
+    std::vector<GstSample*> _retired;
+};
+
+}
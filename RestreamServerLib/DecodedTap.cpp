@@ -0,0 +1,91 @@
+#include "DecodedTap.h"
+
+#include <CxxPtr/GlibPtr.h>
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+std::unique_ptr<DecodedTap> DecodedTap::create(
+    const std::shared_ptr<Channel>& source,
+    const DecodedTapConfig& config)
+{
+    // frames are dropped after decoder since every frame
+    // could be a reference for the next ones
+    const std::string pipelineDesc =
+        fmt::format(
+            "appsrc name=source ! decodebin ! "
+            "videorate drop-only=true ! videoscale ! videoconvert ! "
+            "video/x-raw,format=I420,width={},height={},framerate={}/1 ! "
+            "appsink name=frames",
+            config.width, config.height, config.framerate);
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc.c_str(), &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->critical(
+            "Fail to create decoded tap pipeline: {}",
+            errorPtr->message);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return nullptr;
+    }
+
+    std::shared_ptr<Channel> frames =
+        std::make_shared<Channel>(FramesChannelCapacity);
+
+    GstElementPtr appsrcPtr(gst_bin_get_by_name(GST_BIN(pipeline), "source"));
+    GstElementPtr appsinkPtr(gst_bin_get_by_name(GST_BIN(pipeline), "frames"));
+    Channel::attachAppSrc(source, appsrcPtr.get());
+    Channel::attachAppSink(frames, appsinkPtr.get());
+
+    // the same time domain as media pipelines to keep timestamps as is
+    Private::UseSharedClock(GST_PIPELINE(pipeline));
+
+    std::unique_ptr<DecodedTap> tap(new DecodedTap(pipeline, frames));
+
+    if(GST_STATE_CHANGE_FAILURE == gst_element_set_state(pipeline, GST_STATE_PLAYING)) {
+        Log()->error("Fail to start decoded tap pipeline");
+        return nullptr;
+    }
+
+    return tap;
+}
+
+DecodedTap::DecodedTap(GstElement* pipeline, const std::shared_ptr<Channel>& frames) :
+    _pipeline(pipeline), _busWatch(0), _frames(frames)
+{
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    _busWatch =
+        gst_bus_add_watch(
+            bus,
+            [] (GstBus*, GstMessage* message, gpointer) -> gboolean {
+                if(GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+                    GError* error = nullptr;
+                    gst_message_parse_error(message, &error, nullptr);
+                    GErrorPtr errorPtr(error);
+                    Log()->error(
+                        "DecodedTap. Pipeline error: {}",
+                        errorPtr ? errorPtr->message : "");
+                }
+                return G_SOURCE_CONTINUE;
+            },
+            nullptr);
+    gst_object_unref(bus);
+}
+
+DecodedTap::~DecodedTap()
+{
+    if(_busWatch)
+        g_source_remove(_busWatch);
+
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    gst_object_unref(_pipeline);
+}
+
+}
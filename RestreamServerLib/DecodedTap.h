@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+#include "Server.h"
+
+
+namespace RestreamServerLib
+{
+
+// Decodes path's stream once and publishes raw I420 frames
+// of reduced rate and resolution to own channel
+class DecodedTap
+{
+public:
+    enum {
+        FramesChannelCapacity = 8,
+    };
+
+    static std::unique_ptr<DecodedTap> create(
+        const std::shared_ptr<Channel>& source,
+        const DecodedTapConfig&);
+    ~DecodedTap();
+
+    const std::shared_ptr<Channel>& frames() const
+        { return _frames; }
+
+private:
+    DecodedTap(GstElement* pipeline, const std::shared_ptr<Channel>& frames);
+
+private:
+    GstElement* _pipeline;
+    guint _busWatch;
+
+    const std::shared_ptr<Channel> _frames;
+};
+
+}
@@ -0,0 +1,136 @@
+#include "FrameThinning.h"
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+enum {
+    NalSlice = 1,
+    NalIdrSlice = 5,
+};
+
+}
+
+std::unique_ptr<FrameThinning> FrameThinning::create(
+    const std::shared_ptr<Channel>& source,
+    unsigned fps)
+{
+    if(fps == 0 || fps > MaxFps)
+        return nullptr;
+
+    std::unique_ptr<FrameThinning> thinning(new FrameThinning(source, fps));
+
+    thinning->_listenerId =
+        source->addListener(std::bind(&FrameThinning::drain, thinning.get()));
+    if(thinning->_listenerId == Channel::InvalidListener)
+        return nullptr;
+
+    thinning->drain();
+
+    return thinning;
+}
+
+FrameThinning::FrameThinning(const std::shared_ptr<Channel>& source, unsigned fps) :
+    _source(source), _output(std::make_shared<Channel>()),
+    _frameDuration(GST_SECOND / fps),
+    _listenerId(Channel::InvalidListener), _drainRequests(0),
+    _nextFrameTime(GST_CLOCK_TIME_NONE)
+{
+}
+
+FrameThinning::~FrameThinning()
+{
+    if(_listenerId != Channel::InvalidListener)
+        _source->removeListener(_listenerId);
+}
+
+// access unit is reference one if any of it's slices has nonzero nal_ref_idc
+bool FrameThinning::IsReferenceUnit(GstBuffer* buffer)
+{
+    GstMapInfo mapInfo;
+    if(!gst_buffer_map(buffer, &mapInfo, GST_MAP_READ))
+        return true;
+
+    const guint8* data = mapInfo.data;
+    const gsize size = mapInfo.size;
+
+    bool hasSlices = false;
+    bool reference = false;
+    for(gsize i = 0; i + 3 < size && !reference; ++i) {
+        if(data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+            continue;
+
+        const guint8 nalHeader = data[i + 3];
+        const unsigned nalType = nalHeader & 0x1f;
+        const unsigned nalRefIdc = (nalHeader >> 5) & 0x03;
+        if(nalType == NalSlice || nalType == NalIdrSlice) {
+            hasSlices = true;
+            reference = nalRefIdc != 0 || nalType == NalIdrSlice;
+        }
+
+        i += 3;
+    }
+
+    gst_buffer_unmap(buffer, &mapInfo);
+
+    // unknown content is kept to not break decoding
+    return reference || !hasSlices;
+}
+
+void FrameThinning::drain()
+{
+    Private::CombineDrains(
+        &_drainRequests,
+        [this] () {
+            while(GstSample* sample = _source->pull(_listenerId))
+                filter(sample);
+        });
+}
+
+void FrameThinning::filter(GstSample* sample)
+{
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if(!buffer) {
+        gst_sample_unref(sample);
+        return;
+    }
+
+    const GstClockTime time =
+        GST_BUFFER_DTS_IS_VALID(buffer) ?
+            GST_BUFFER_DTS(buffer) :
+            GST_BUFFER_PTS(buffer);
+
+    // some jitter of source timestamps is tolerated,
+    // jump back (i.e. on recorder change) restarts schedule
+    const bool due =
+        !GST_CLOCK_TIME_IS_VALID(time) ||
+        !GST_CLOCK_TIME_IS_VALID(_nextFrameTime) ||
+        time + _frameDuration / 4 >= _nextFrameTime ||
+        time + GST_SECOND < _nextFrameTime;
+
+    if(!due && !IsReferenceUnit(buffer)) {
+        gst_sample_unref(sample);
+        return;
+    }
+
+    if(due && GST_CLOCK_TIME_IS_VALID(time)) {
+        // don't let schedule fall behind after gaps or on timestamps jump
+        if(GST_CLOCK_TIME_IS_VALID(_nextFrameTime) &&
+           time + GST_SECOND >= _nextFrameTime &&
+           time < _nextFrameTime + _frameDuration)
+        {
+            _nextFrameTime += _frameDuration;
+        } else
+            _nextFrameTime = time + _frameDuration;
+    }
+
+    _output->push(sample);
+}
+
+}
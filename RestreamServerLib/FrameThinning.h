@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// Republishes H.264 access units of source channel to own channel
+// with frame rate reduced to target one by dropping non-reference
+// (nal_ref_idc == 0) frames, i.e. without transcoding.
+// Reference frames are always passed, so target frame rate
+// is reachable only if stream has enough non-reference frames.
+class FrameThinning
+{
+public:
+    enum {
+        MaxFps = 60,
+    };
+
+    static std::unique_ptr<FrameThinning> create(
+        const std::shared_ptr<Channel>& source,
+        unsigned fps);
+    ~FrameThinning();
+
+    const std::shared_ptr<Channel>& output() const
+        { return _output; }
+
+private:
+    FrameThinning(const std::shared_ptr<Channel>& source, unsigned fps);
+
+    static bool IsReferenceUnit(GstBuffer*);
+
+    void drain();
+    void filter(GstSample*);
+
+private:
+    const std::shared_ptr<Channel> _source;
+    const std::shared_ptr<Channel> _output;
+    const GstClockTime _frameDuration;
+
+    Channel::ListenerId _listenerId;
+    std::atomic<unsigned> _drainRequests;
+
+    // accessed from draining thread only
+    GstClockTime _nextFrameTime;
+};
+
+}
@@ -0,0 +1,181 @@
+#include "IngestMirror.h"
+
+#include <gst/rtsp/gstrtspurl.h>
+
+#include <CxxPtr/GlibPtr.h>
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+// url's user info is dropped, i.e. "10.0.0.2:8001/path?record"
+std::string LogUrl(const std::string& url)
+{
+    GstRTSPUrl* parsedUrl = nullptr;
+    if(GST_RTSP_OK != gst_rtsp_url_parse(url.c_str(), &parsedUrl) || !parsedUrl)
+        return "<invalid url>";
+
+    std::string logUrl =
+        fmt::format(
+            "{}:{}{}",
+            parsedUrl->host ? parsedUrl->host : "",
+            parsedUrl->port,
+            parsedUrl->abspath ? parsedUrl->abspath : "");
+    if(parsedUrl->query)
+        logUrl += fmt::format("?{}", parsedUrl->query);
+
+    gst_rtsp_url_free(parsedUrl);
+
+    return logUrl;
+}
+
+}
+
+IngestMirror::IngestMirror(
+    const std::shared_ptr<Channel>& source,
+    const std::string& recordUrl) :
+    _source(source), _recordUrl(recordUrl), _logUrl(LogUrl(recordUrl)),
+    _pipeline(nullptr), _busWatch(0), _retryTimeout(0)
+{
+}
+
+IngestMirror::~IngestMirror()
+{
+    if(_retryTimeout)
+        g_source_remove(_retryTimeout);
+
+    stopPipeline();
+}
+
+bool IngestMirror::start()
+{
+    return startPipeline();
+}
+
+bool IngestMirror::startPipeline()
+{
+    const std::string pipelineDesc =
+        "appsrc name=channel ! h264parse config-interval=-1 ! "
+        "rtspclientsink name=sink protocols=tcp";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc.c_str(), &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->critical(
+            "Fail to create ingest mirror pipeline: {}",
+            errorPtr->message);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return false;
+    }
+
+    _pipeline = pipeline;
+
+    GstElementPtr sinkPtr(gst_bin_get_by_name(GST_BIN(pipeline), "sink"));
+    g_object_set(sinkPtr.get(), "location", _recordUrl.c_str(), NULL);
+
+    GstElementPtr appsrcPtr(gst_bin_get_by_name(GST_BIN(pipeline), "channel"));
+    Channel::attachAppSrc(_source, appsrcPtr.get());
+
+    // standby's keyframe requests come as upstream force key unit events
+    GstPadPtr appsrcPadPtr(gst_element_get_static_pad(appsrcPtr.get(), "src"));
+    gst_pad_add_probe(
+        appsrcPadPtr.get(),
+        GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+        [] (GstPad*, GstPadProbeInfo* info, gpointer userData) -> GstPadProbeReturn {
+            GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+            if(event &&
+               GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_UPSTREAM &&
+               gst_event_has_name(event, "GstForceKeyUnit"))
+            {
+                IngestMirror* self = static_cast<IngestMirror*>(userData);
+                self->_source->requestKeyframe();
+            }
+            return GST_PAD_PROBE_OK;
+        },
+        this, nullptr);
+
+    // the same time domain as media pipelines to keep timestamps as is
+    Private::UseSharedClock(GST_PIPELINE(pipeline));
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    _busWatch =
+        gst_bus_add_watch(
+            bus,
+            [] (GstBus*, GstMessage* message, gpointer userData) -> gboolean {
+                IngestMirror* self = static_cast<IngestMirror*>(userData);
+                switch(GST_MESSAGE_TYPE(message)) {
+                case GST_MESSAGE_ERROR: {
+                    GError* error = nullptr;
+                    gst_message_parse_error(message, &error, nullptr);
+                    GErrorPtr errorPtr(error);
+                    Log()->error(
+                        "IngestMirror. Pipeline error: {}. url: {}",
+                        errorPtr ? errorPtr->message : "", self->_logUrl);
+                    self->scheduleRetry();
+                    break;
+                }
+                case GST_MESSAGE_EOS:
+                    self->scheduleRetry();
+                    break;
+                default:
+                    break;
+                }
+                return G_SOURCE_CONTINUE;
+            },
+            this);
+    gst_object_unref(bus);
+
+    if(GST_STATE_CHANGE_FAILURE == gst_element_set_state(pipeline, GST_STATE_PLAYING)) {
+        Log()->error("IngestMirror. Fail to start. url: {}", _logUrl);
+        scheduleRetry();
+        return false;
+    }
+
+    Log()->info("IngestMirror. Mirroring to {}", _logUrl);
+
+    return true;
+}
+
+void IngestMirror::stopPipeline()
+{
+    if(!_pipeline)
+        return;
+
+    if(_busWatch) {
+        g_source_remove(_busWatch);
+        _busWatch = 0;
+    }
+
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    gst_object_unref(_pipeline);
+    _pipeline = nullptr;
+}
+
+void IngestMirror::scheduleRetry()
+{
+    if(_retryTimeout)
+        return;
+
+    _retryTimeout =
+        g_timeout_add_seconds(
+            RetryInterval,
+            [] (gpointer userData) -> gboolean {
+                IngestMirror* self = static_cast<IngestMirror*>(userData);
+                self->_retryTimeout = 0;
+                self->stopPipeline();
+                self->startPipeline();
+                return G_SOURCE_REMOVE;
+            },
+            this);
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// Forwards access units of path's channel to standby node
+// as ordinary RTSP recorder, so standby has the path's channel fed
+// and players could fail over to it with only keyframe wait.
+// Keyframe requests of standby are forwarded to source channel.
+// Connection is retried while mirror is alive.
+class IngestMirror
+{
+public:
+    enum {
+        RetryInterval = 5, // seconds
+    };
+
+    // recordUrl is full url of path on standby, i.e. "rtsp://10.0.0.2:8001/path?record"
+    IngestMirror(const std::shared_ptr<Channel>& source, const std::string& recordUrl);
+    ~IngestMirror();
+
+    bool start();
+
+private:
+    bool startPipeline();
+    void stopPipeline();
+    void scheduleRetry();
+
+private:
+    const std::shared_ptr<Channel> _source;
+    const std::string _recordUrl;
+    // without credentials
+    const std::string _logUrl;
+
+    GstElement* _pipeline;
+    guint _busWatch;
+    guint _retryTimeout;
+};
+
+}
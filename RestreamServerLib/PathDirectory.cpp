@@ -0,0 +1,344 @@
+#include "PathDirectory.h"
+
+#include "Log.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+const std::string MessageMagic = "RSDIR1 ";
+
+}
+
+PathDirectory::PathDirectory(const std::string& nodeUrl) :
+    _nodeUrl(nodeUrl),
+    _socket(nullptr), _socketSource(nullptr),
+    _heartbeatTimeout(0)
+{
+}
+
+PathDirectory::~PathDirectory()
+{
+    if(_heartbeatTimeout)
+        g_source_remove(_heartbeatTimeout);
+
+    if(_socketSource) {
+        g_source_destroy(_socketSource);
+        g_source_unref(_socketSource);
+    }
+
+    if(_socket)
+        g_object_unref(_socket);
+
+    for(GSocketAddress* peer: _peers)
+        g_object_unref(peer);
+}
+
+bool PathDirectory::listen(unsigned short port, const std::string& bindAddress)
+{
+    if(_socket)
+        return false;
+
+    GError* error = nullptr;
+    _socket =
+        g_socket_new(
+            G_SOCKET_FAMILY_IPV4,
+            G_SOCKET_TYPE_DATAGRAM,
+            G_SOCKET_PROTOCOL_UDP,
+            &error);
+    if(!_socket) {
+        Log()->error("PathDirectory. Fail to create socket: {}", error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    g_socket_set_blocking(_socket, FALSE);
+
+    GInetAddress* inetAddress =
+        bindAddress.empty() ?
+            g_inet_address_new_any(G_SOCKET_FAMILY_IPV4) :
+            g_inet_address_new_from_string(bindAddress.c_str());
+    if(!inetAddress ||
+       G_SOCKET_FAMILY_IPV4 != g_inet_address_get_family(inetAddress))
+    {
+        Log()->error("PathDirectory. Invalid bind address: {}", bindAddress);
+        if(inetAddress)
+            g_object_unref(inetAddress);
+        g_object_unref(_socket);
+        _socket = nullptr;
+        return false;
+    }
+    GSocketAddress* address = g_inet_socket_address_new(inetAddress, port);
+    g_object_unref(inetAddress);
+
+    const bool bound = g_socket_bind(_socket, address, TRUE, &error);
+    g_object_unref(address);
+    if(!bound) {
+        Log()->error("PathDirectory. Fail to bind port {}: {}", port, error->message);
+        g_error_free(error);
+        g_object_unref(_socket);
+        _socket = nullptr;
+        return false;
+    }
+
+    _socketSource = g_socket_create_source(_socket, G_IO_IN, nullptr);
+    g_source_set_callback(
+        _socketSource,
+        (GSourceFunc)
+        (gboolean (*)(GSocket*, GIOCondition, gpointer))
+        [] (GSocket*, GIOCondition, gpointer userData) -> gboolean {
+            static_cast<PathDirectory*>(userData)->receive();
+            return G_SOURCE_CONTINUE;
+        },
+        this, nullptr);
+    g_source_attach(_socketSource, g_main_context_get_thread_default());
+
+    _heartbeatTimeout =
+        g_timeout_add_seconds(
+            HeartbeatInterval,
+            [] (gpointer userData) -> gboolean {
+                static_cast<PathDirectory*>(userData)->heartbeat();
+                return G_SOURCE_CONTINUE;
+            },
+            this);
+
+    Log()->info(
+        "PathDirectory. Listening on {}:{}",
+        bindAddress.empty() ? "0.0.0.0" : bindAddress, port);
+
+    return true;
+}
+
+bool PathDirectory::addPeer(const std::string& host, unsigned short port)
+{
+    GSocketAddress* address = g_inet_socket_address_new_from_string(host.c_str(), port);
+    if(!address) {
+        Log()->error("PathDirectory. Invalid peer address: {}", host);
+        return false;
+    }
+
+    _peers.push_back(address);
+
+    return true;
+}
+
+void PathDirectory::announce(const std::string& path)
+{
+    if(!_localPaths.insert(path).second)
+        return;
+
+    {
+        // publisher moved to this node
+        std::lock_guard<std::mutex> lock(_remoteMutex);
+        _remotePaths.erase(path);
+    }
+
+    send({ "+" + path });
+}
+
+void PathDirectory::withdraw(const std::string& path)
+{
+    if(0 == _localPaths.erase(path))
+        return;
+
+    send({ "-" + path });
+}
+
+std::string PathDirectory::lookup(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(_remoteMutex);
+
+    auto it = _remotePaths.find(path);
+    if(it == _remotePaths.end())
+        return std::string();
+
+    const gint64 expireTime =
+        gint64(HeartbeatInterval) * ExpireHeartbeats * G_USEC_PER_SEC;
+    if(g_get_monotonic_time() - it->second.lastSeen > expireTime)
+        return std::string();
+
+    return it->second.nodeUrl + path;
+}
+
+void PathDirectory::heartbeat()
+{
+    std::vector<std::string> lines;
+    lines.reserve(_localPaths.size());
+    for(const std::string& path: _localPaths)
+        lines.push_back("+" + path);
+
+    if(!lines.empty())
+        send(lines);
+
+    const gint64 expireTime =
+        gint64(HeartbeatInterval) * ExpireHeartbeats * G_USEC_PER_SEC;
+    const gint64 now = g_get_monotonic_time();
+
+    std::lock_guard<std::mutex> lock(_remoteMutex);
+    for(auto it = _remotePaths.begin(); it != _remotePaths.end();) {
+        if(now - it->second.lastSeen > expireTime) {
+            Log()->debug(
+                "PathDirectory. Path expired. path: {}, node: {}",
+                it->first, it->second.nodeUrl);
+            it = _remotePaths.erase(it);
+        } else
+            ++it;
+    }
+}
+
+// lines are packed to as few datagrams as possible
+void PathDirectory::send(const std::vector<std::string>& lines)
+{
+    if(!_socket || _peers.empty())
+        return;
+
+    const std::string header = MessageMagic + _nodeUrl + "\n";
+
+    auto flush =
+        [this] (const std::string& datagram) {
+            for(GSocketAddress* peer: _peers) {
+                GError* error = nullptr;
+                if(g_socket_send_to(
+                    _socket, peer,
+                    datagram.data(), datagram.size(),
+                    nullptr, &error) < 0)
+                {
+                    Log()->debug("PathDirectory. Send failed: {}", error->message);
+                    g_error_free(error);
+                }
+            }
+        };
+
+    std::string datagram = header;
+    for(const std::string& line: lines) {
+        if(datagram.size() > header.size() &&
+           datagram.size() + line.size() + 1 > MaxDatagramSize)
+        {
+            flush(datagram);
+            datagram = header;
+        }
+        datagram += line;
+        datagram += '\n';
+    }
+
+    if(datagram.size() > header.size())
+        flush(datagram);
+}
+
+void PathDirectory::receive()
+{
+    gchar buffer[65536];
+    for(;;) {
+        GSocketAddress* source = nullptr;
+        const gssize size =
+            g_socket_receive_from(
+                _socket, &source,
+                buffer, sizeof(buffer),
+                nullptr, nullptr);
+        if(size <= 0) {
+            if(source)
+                g_object_unref(source);
+            break;
+        }
+
+        if(isPeer(source))
+            handleDatagram(buffer, size);
+        else
+            Log()->debug("PathDirectory. Datagram from unknown node dropped");
+
+        if(source)
+            g_object_unref(source);
+    }
+}
+
+// peers send from their gossip port
+bool PathDirectory::isPeer(GSocketAddress* address) const
+{
+    if(!G_IS_INET_SOCKET_ADDRESS(address))
+        return false;
+
+    GInetSocketAddress* inetSocketAddress = G_INET_SOCKET_ADDRESS(address);
+    GInetAddress* inetAddress = g_inet_socket_address_get_address(inetSocketAddress);
+    const guint16 port = g_inet_socket_address_get_port(inetSocketAddress);
+
+    for(GSocketAddress* peer: _peers) {
+        GInetSocketAddress* peerAddress = G_INET_SOCKET_ADDRESS(peer);
+        if(port == g_inet_socket_address_get_port(peerAddress) &&
+           g_inet_address_equal(inetAddress, g_inet_socket_address_get_address(peerAddress)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PathDirectory::handleDatagram(const gchar* data, gsize size)
+{
+    const std::string datagram(data, size);
+
+    if(0 != datagram.compare(0, MessageMagic.size(), MessageMagic))
+        return;
+
+    std::string::size_type lineEnd = datagram.find('\n');
+    if(lineEnd == std::string::npos)
+        return;
+
+    const std::string nodeUrl =
+        datagram.substr(MessageMagic.size(), lineEnd - MessageMagic.size());
+    if(nodeUrl.empty() || nodeUrl == _nodeUrl)
+        return;
+
+    const gint64 now = g_get_monotonic_time();
+
+    std::lock_guard<std::mutex> lock(_remoteMutex);
+
+    for(std::string::size_type lineBegin = lineEnd + 1;
+        lineBegin < datagram.size();
+        lineBegin = lineEnd + 1)
+    {
+        lineEnd = datagram.find('\n', lineBegin);
+        if(lineEnd == std::string::npos)
+            lineEnd = datagram.size();
+
+        if(lineEnd - lineBegin < 2)
+            continue;
+
+        const std::string path = datagram.substr(lineBegin + 1, lineEnd - lineBegin - 1);
+        switch(datagram[lineBegin]) {
+        case '+': {
+            // stale announcement of path already moved to this node
+            if(_localPaths.end() != _localPaths.find(path))
+                break;
+
+            RemoteEntry& entry = _remotePaths[path];
+            if(entry.nodeUrl != nodeUrl) {
+                Log()->debug(
+                    "PathDirectory. Path published. path: {}, node: {}",
+                    path, nodeUrl);
+            }
+            // the latest announcement wins
+            entry.nodeUrl = nodeUrl;
+            entry.lastSeen = now;
+            break;
+        }
+        case '-': {
+            auto it = _remotePaths.find(path);
+            if(it != _remotePaths.end() && it->second.nodeUrl == nodeUrl) {
+                Log()->debug(
+                    "PathDirectory. Path withdrawn. path: {}, node: {}",
+                    path, nodeUrl);
+                _remotePaths.erase(it);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gio/gio.h>
+
+
+namespace RestreamServerLib
+{
+
+// Directory of paths published on cluster nodes.
+// Every node sends paths published on it to all peers over UDP
+// on every change and periodically, so peers know owner of path
+// without asking anybody. Entries not refreshed in time expire.
+// Datagram format (text):
+//   RSDIR1 <node url>\n
+//   +<published path>\n
+//   -<withdrawn path>\n
+//   ...
+// Datagrams are accepted only from address and port of configured peers,
+// but they are not authenticated, so gossip port should not be exposed publicly.
+class PathDirectory
+{
+public:
+    enum {
+        HeartbeatInterval = 2, // seconds
+        ExpireHeartbeats = 3,
+        MaxDatagramSize = 1400,
+    };
+
+    // nodeUrl is base url players are redirected to, i.e. "rtsp://10.0.0.1:8001"
+    explicit PathDirectory(const std::string& nodeUrl);
+    ~PathDirectory();
+
+    // bindAddress should be numeric IP address, empty means any
+    bool listen(unsigned short port, const std::string& bindAddress = std::string());
+    // host should be numeric IP address
+    bool addPeer(const std::string& host, unsigned short port);
+
+    // path was published or unpublished on this node
+    void announce(const std::string& path);
+    void withdraw(const std::string& path);
+
+    // returns url of path on node owning it,
+    // or empty string if path is owned by this node or unknown,
+    // could be called from any thread
+    std::string lookup(const std::string& path) const;
+
+private:
+    struct RemoteEntry
+    {
+        std::string nodeUrl;
+        gint64 lastSeen; // monotonic, us
+    };
+
+    void heartbeat();
+    void receive();
+    bool isPeer(GSocketAddress*) const;
+    void handleDatagram(const gchar* data, gsize size);
+    void send(const std::vector<std::string>& lines);
+
+private:
+    const std::string _nodeUrl;
+
+    GSocket* _socket;
+    GSource* _socketSource;
+    guint _heartbeatTimeout;
+    std::vector<GSocketAddress*> _peers;
+
+    // accessed from main context only
+    std::set<std::string> _localPaths;
+
+    mutable std::mutex _remoteMutex;
+    std::map<std::string, RemoteEntry> _remotePaths;
+};
+
+}
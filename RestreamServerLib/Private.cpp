@@ -1,5 +1,12 @@
 #include "Private.h"
 
+#include <atomic>
+#include <mutex>
+
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+
 
 namespace RestreamServerLib
 {
@@ -10,6 +17,81 @@ namespace Private
 
 const gchar* RecordSuffix= RECORD_SUFFIX;
 
+#define SUB_SUFFIX "sub"
+#define SUB_RECORD_SUFFIX RECORD_SUFFIX "&" SUB_SUFFIX
+
+const gchar* SubSuffix = SUB_SUFFIX;
+const gchar* SubRecordSuffix = SUB_RECORD_SUFFIX;
+
+#define TILES_SUFFIX "tiles"
+
+const gchar* TilesSuffix = TILES_SUFFIX;
+
+const unsigned MaxTiles = 64;
+
+const gchar* SessionResumeHeader = "X-Resume-Token";
+
+const unsigned ClosedClientsBatchSize = 256;
+
+namespace
+{
+
+const gchar* BusFilterKey = "bus-filter";
+
+struct BusFilter
+{
+    GstElement* pipeline; // not referenced, owns bus the filter is installed on
+    std::atomic<bool> latencyPending { false };
+};
+
+std::atomic<guint64> DispatchedBusMessages { 0 };
+
+// called from streaming threads
+GstBusSyncReply FilterBusMessage(GstBus*, GstMessage* message, gpointer userData)
+{
+    BusFilter* filter = static_cast<BusFilter*>(userData);
+
+    switch(GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_STATE_CHANGED:
+        // only pipeline's state is tracked by GstRTSPMedia
+        return GST_MESSAGE_SRC(message) == GST_OBJECT(filter->pipeline) ?
+            GST_BUS_PASS : GST_BUS_DROP;
+    case GST_MESSAGE_ELEMENT:
+        // rtsp-stream reports preroll of live pipelines this way
+        return gst_message_has_name(message, "GstRTSPStreamBlocking") ?
+            GST_BUS_PASS : GST_BUS_DROP;
+    case GST_MESSAGE_LATENCY:
+        // the whole pipeline latency is recalculated on every message,
+        // so one pending is enough
+        return filter->latencyPending.exchange(true) ?
+            GST_BUS_DROP : GST_BUS_PASS;
+    case GST_MESSAGE_WARNING: {
+        GError* error = nullptr;
+        gst_message_parse_warning(message, &error, nullptr);
+        Log()->warn(
+            "Media pipeline warning: {}",
+            error ? error->message : "");
+        if(error)
+            g_error_free(error);
+        return GST_BUS_DROP;
+    }
+    case GST_MESSAGE_QOS:
+    case GST_MESSAGE_TAG:
+    case GST_MESSAGE_INFO:
+    case GST_MESSAGE_STREAM_STATUS:
+    case GST_MESSAGE_STREAM_START:
+    case GST_MESSAGE_DURATION_CHANGED:
+    case GST_MESSAGE_NEW_CLOCK:
+    case GST_MESSAGE_PROGRESS:
+        return GST_BUS_DROP;
+    default:
+        // errors, EOS, async done, buffering and the rest
+        return GST_BUS_PASS;
+    }
+}
+
+}
+
 bool IsRecordUrl(GstRTSPMethod method, const GstRTSPUrl* url)
 {
     bool record = false;
@@ -21,7 +103,183 @@ bool IsRecordUrl(GstRTSPMethod method, const GstRTSPUrl* url)
         }
     }
 
-    return record;
+    return record || IsSubRecordUrl(method, url);
+}
+
+bool IsSubRecordUrl(GstRTSPMethod method, const GstRTSPUrl* url)
+{
+    if(url->query == nullptr)
+        return false;
+
+    return
+        0 == g_strcmp0(url->query, SubRecordSuffix) ||
+        (GST_RTSP_SETUP == method &&
+         g_str_has_prefix(url->query, SUB_RECORD_SUFFIX "/"));
+}
+
+bool ParseTilesUrl(const GstRTSPUrl* url, std::vector<std::string>* paths)
+{
+    if(!url->query ||
+       (0 != g_strcmp0(url->query, TilesSuffix) &&
+        !g_str_has_prefix(url->query, TILES_SUFFIX "/")))
+    {
+        return false;
+    }
+
+    std::vector<std::string> tiles;
+
+    const std::string abspath = url->abspath;
+    std::string::size_type tileBegin = 0;
+    for(;;) {
+        const std::string::size_type tileEnd = abspath.find(',', tileBegin);
+        const std::string tile =
+            abspath.substr(
+                tileBegin,
+                tileEnd == std::string::npos ? std::string::npos : tileEnd - tileBegin);
+        if(tile.size() < 2 || tile[0] != '/')
+            return false;
+
+        tiles.push_back(tile);
+        if(tiles.size() > MaxTiles)
+            return false;
+
+        if(tileEnd == std::string::npos)
+            break;
+
+        tileBegin = tileEnd + 1;
+    }
+
+    if(paths)
+        paths->swap(tiles);
+
+    return true;
+}
+
+GSource* AttachIdle(GSourceFunc callback, gpointer userData)
+{
+    GSource* source = g_idle_source_new();
+    g_source_set_callback(source, callback, userData, nullptr);
+    g_source_attach(source, g_main_context_get_thread_default());
+
+    return source;
+}
+
+void DestroySource(GSource** source)
+{
+    if(!*source)
+        return;
+
+    g_source_destroy(*source);
+    g_source_unref(*source);
+    *source = nullptr;
+}
+
+GstClock* SharedClock()
+{
+    static GstClock* clock = gst_system_clock_obtain();
+
+    return clock;
+}
+
+GstClockTime SharedBaseTime()
+{
+    static const GstClockTime baseTime = gst_clock_get_time(SharedClock());
+
+    return baseTime;
+}
+
+void UseSharedBaseTime(GstRTSPMedia* media)
+{
+    GstElementPtr elementPtr(gst_rtsp_media_get_element(media));
+    GstElementPtr pipelinePtr(
+        GST_ELEMENT(gst_object_get_parent(GST_OBJECT(elementPtr.get()))));
+    GstElement* pipeline = pipelinePtr.get();
+    if(!pipeline)
+        return;
+
+    // base time will not be recalculated on state changes
+    gst_element_set_start_time(pipeline, GST_CLOCK_TIME_NONE);
+    gst_element_set_base_time(pipeline, SharedBaseTime());
+}
+
+void UseSharedClock(GstPipeline* pipeline)
+{
+    gst_pipeline_use_clock(pipeline, SharedClock());
+    // base time will not be recalculated on state changes
+    gst_element_set_start_time(GST_ELEMENT(pipeline), GST_CLOCK_TIME_NONE);
+    gst_element_set_base_time(GST_ELEMENT(pipeline), SharedBaseTime());
+}
+
+void CombineDrains(std::atomic<unsigned>* drainRequests, const std::function<void ()>& drain)
+{
+    if(drainRequests->fetch_add(1) > 0)
+        return; // thread already draining will do the work
+
+    unsigned handled = 1;
+    do {
+        drain();
+        handled = drainRequests->fetch_sub(handled) - handled;
+    } while(handled != 0);
+}
+
+void FilterBusMessages(GstRTSPMedia* media)
+{
+    GstElementPtr elementPtr(gst_rtsp_media_get_element(media));
+    GstElementPtr pipelinePtr(
+        GST_ELEMENT(gst_object_get_parent(GST_OBJECT(elementPtr.get()))));
+    GstElement* pipeline = pipelinePtr.get();
+    if(!pipeline)
+        return;
+
+    BusFilter* filter = new BusFilter;
+    filter->pipeline = pipeline;
+
+    // filter is owned by bus, and bus is owned by pipeline owned by media
+    g_object_set_data(G_OBJECT(media), BusFilterKey, filter);
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(
+        bus,
+        FilterBusMessage,
+        filter,
+        [] (gpointer userData) {
+            delete static_cast<BusFilter*>(userData);
+        });
+    gst_object_unref(bus);
+}
+
+void BusMessageDispatched(GstRTSPMedia* media, GstMessage* message)
+{
+    DispatchedBusMessages.fetch_add(1, std::memory_order_relaxed);
+
+    if(GST_MESSAGE_TYPE(message) != GST_MESSAGE_LATENCY)
+        return;
+
+    BusFilter* filter =
+        static_cast<BusFilter*>(g_object_get_data(G_OBJECT(media), BusFilterKey));
+    if(filter)
+        filter->latencyPending = false;
+}
+
+unsigned DispatchedBusMessagesRate()
+{
+    static std::mutex mutex;
+    static gint64 sampleTime = g_get_monotonic_time();
+    static guint64 sampleCount = 0;
+    static unsigned rate = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // averaged over at least one second since previous sample
+    const gint64 now = g_get_monotonic_time();
+    if(now - sampleTime >= G_USEC_PER_SEC) {
+        const guint64 count = DispatchedBusMessages.load(std::memory_order_relaxed);
+        rate = unsigned((count - sampleCount) * G_USEC_PER_SEC / (now - sampleTime));
+        sampleTime = now;
+        sampleCount = count;
+    }
+
+    return rate;
 }
 
 }
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
 #include <glib.h>
+#include <gst/gst.h>
 #include <gst/rtsp/gstrtspdefs.h>
 #include <gst/rtsp/gstrtspurl.h>
+#include <gst/rtsp-server/rtsp-media.h>
 
 
 namespace RestreamServerLib
@@ -12,7 +19,56 @@ namespace Private
 
 extern const gchar* RecordSuffix;
 
+extern const gchar* SessionResumeHeader;
+
+// max count of closed clients cleaned up per one main loop iteration
+extern const unsigned ClosedClientsBatchSize;
+
+// "?sub" plays the lowest resolution stream of path available,
+// "?record&sub" publishes sub stream of path
+extern const gchar* SubSuffix;
+extern const gchar* SubRecordSuffix;
+
+// true for sub stream record url as well
 bool IsRecordUrl(GstRTSPMethod, const GstRTSPUrl*);
+bool IsSubRecordUrl(GstRTSPMethod, const GstRTSPUrl*);
+
+extern const gchar* TilesSuffix;
+
+// max count of paths in one aggregate url
+extern const unsigned MaxTiles;
+
+// aggregate url streaming several paths in one session,
+// i.e. "/path1,/path2?tiles" optionally followed by "/control" of SETUP url,
+// returns false if url is not aggregate one or is malformed
+bool ParseTilesUrl(const GstRTSPUrl*, std::vector<std::string>* paths);
+
+// attaches idle source to thread default main context,
+// i.e. to the context of the client's thread when called from client signals
+GSource* AttachIdle(GSourceFunc, gpointer userData);
+void DestroySource(GSource**);
+
+// clock and base time shared by all media pipelines,
+// so running time of buffer is the same in every of them
+GstClock* SharedClock();
+GstClockTime SharedBaseTime();
+void UseSharedBaseTime(GstRTSPMedia*);
+// for standalone pipelines feeding or fed by channels
+void UseSharedClock(GstPipeline*);
+
+// combines concurrent drain requests of channel listener
+// the same way as appsrc glue does: whatever thread comes first
+// calls drain until no more requests arrived meanwhile
+void CombineDrains(std::atomic<unsigned>* drainRequests, const std::function<void ()>& drain);
+
+// installs sync handler on media's pipeline bus dropping messages
+// GstRTSPMedia doesn't need before they reach main context,
+// only one latency message is let through until it's handled
+void FilterBusMessages(GstRTSPMedia*);
+// should be called from media's handle_message for every dispatched message
+void BusMessageDispatched(GstRTSPMedia*, GstMessage*);
+// bus messages of all media dispatched on main context per second
+unsigned DispatchedBusMessagesRate();
 
 }
 }
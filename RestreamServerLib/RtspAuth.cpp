@@ -15,6 +15,7 @@ struct CxxPrivate
 {
     AuthCallbacks callbacks;
     bool useTls;
+    std::shared_ptr<SessionResume> sessionResume;
 };
 
 struct _RtspAuth
@@ -65,6 +66,14 @@ rtsp_auth_new(const AuthCallbacks& callbacks, bool useTls)
     return instance;
 }
 
+void
+rtsp_auth_set_session_resume(
+    RtspAuth* self,
+    const std::shared_ptr<SessionResume>& sessionResume)
+{
+    self->p->sessionResume = sessionResume;
+}
+
 static void
 rtsp_auth_class_init(RtspAuthClass* klass)
 {
@@ -141,14 +150,23 @@ authentication_required(
     GstRTSPMethod method,
     const GstRTSPUrl* url)
 {
-    if(auth->p->callbacks.authenticationRequired)
-        return
-            auth->p->callbacks.authenticationRequired(
-                method,
-                url->abspath,
-                Private::IsRecordUrl(method, url));
-    else
+    if(!auth->p->callbacks.authenticationRequired)
         return false;
+
+    std::vector<std::string> tiles;
+    if(Private::ParseTilesUrl(url, &tiles)) {
+        for(const std::string& tile: tiles) {
+            if(auth->p->callbacks.authenticationRequired(method, tile, false))
+                return true;
+        }
+        return false;
+    }
+
+    return
+        auth->p->callbacks.authenticationRequired(
+            method,
+            url->abspath,
+            Private::IsRecordUrl(method, url));
 }
 
 static bool
@@ -173,6 +191,15 @@ authorize(
     GstRTSPMethod method,
     const GstRTSPUrl* url)
 {
+    std::vector<std::string> tiles;
+    if(auth->p->callbacks.authorize && Private::ParseTilesUrl(url, &tiles)) {
+        for(const std::string& tile: tiles) {
+            if(!auth->p->callbacks.authorize(userName, action, tile, false))
+                return false;
+        }
+        return true;
+    }
+
     if(auth->p->callbacks.authorize)
         return
             auth->p->callbacks.authorize(
@@ -311,6 +338,77 @@ basic_authenticate(
 }
 #endif
 
+static bool
+resume_token(
+    RtspAuth* self,
+    GstRTSPContext* ctx,
+    std::string* user,
+    std::string* path)
+{
+    if(!self->p->sessionResume || !ctx->request)
+        return false;
+
+    gchar* token = nullptr;
+    if(GST_RTSP_OK != gst_rtsp_message_get_header_by_name(
+        ctx->request, Private::SessionResumeHeader, &token, 0))
+    {
+        return false;
+    }
+
+    // token becomes bound to the first connection using it
+    return self->p->sessionResume->claim(token, ctx->client, user, path);
+}
+
+// token resumes playing of it's own path only
+static bool
+resume_token_applies(
+    GstRTSPContext* ctx,
+    const std::string& tokenPath)
+{
+    return
+        tokenPath == ctx->uri->abspath &&
+        !Private::IsRecordUrl(ctx->method, ctx->uri);
+}
+
+static bool
+authenticate_by_resume_token(
+    RtspAuth* self,
+    GstRTSPContext* ctx)
+{
+    std::string userName;
+    std::string tokenPath;
+    if(!resume_token(self, ctx, &userName, &tokenPath))
+        return false;
+
+    // otherwise it's authenticated with regular credentials
+    if(!resume_token_applies(ctx, tokenPath))
+        return false;
+
+    ctx->token =
+        gst_rtsp_token_new(
+            GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE, G_TYPE_STRING,
+            userName.data(), NULL);
+
+    return true;
+}
+
+// restores authorization decision made for resumed session
+static bool
+authorized_by_resume_token(
+    RtspAuth* self,
+    GstRTSPContext* ctx,
+    const gchar* userName)
+{
+    std::string tokenUser;
+    std::string tokenPath;
+    if(!resume_token(self, ctx, &tokenUser, &tokenPath))
+        return false;
+
+    return
+        tokenUser == (userName ? userName : "") &&
+        resume_token_applies(ctx, tokenPath);
+}
+
 static gboolean
 authenticate(
     GstRTSPAuth* auth,
@@ -328,6 +426,11 @@ authenticate(
         return TRUE;
     }
 
+    if(authenticate_by_resume_token(self, ctx)) {
+        Log()->debug("authenticate. authenticated by resume token");
+        return TRUE;
+    }
+
     GstRTSPToken* defaultToken = gst_rtsp_auth_get_default_token(auth);
     // FIXME! it looks like we shouldn't add ref to token. Look rtsp-auth.c:747
     gst_rtsp_token_unref(defaultToken);
@@ -431,7 +534,9 @@ check(
             const gchar* user =
                 gst_rtsp_token_get_string(ctx->token, GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE);
 
-            if(g_str_equal(check, GST_RTSP_AUTH_CHECK_MEDIA_FACTORY_ACCESS))
+            if(authorized_by_resume_token(self, ctx, user))
+                success = TRUE;
+            else if(g_str_equal(check, GST_RTSP_AUTH_CHECK_MEDIA_FACTORY_ACCESS))
                 success = authorize(self, user, Action::ACCESS, ctx->method, ctx->uri);
             else if(g_str_equal(check, GST_RTSP_AUTH_CHECK_MEDIA_FACTORY_CONSTRUCT))
                 success = authorize(self, user, Action::CONSTRUCT, ctx->method, ctx->uri);
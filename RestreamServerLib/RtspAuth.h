@@ -1,10 +1,12 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include <gst/rtsp-server/rtsp-server.h>
 
 #include "Action.h"
+#include "SessionResume.h"
 
 
 namespace RestreamServerLib
@@ -31,6 +33,12 @@ G_DECLARE_FINAL_TYPE(
 RtspAuth*
 rtsp_auth_new(const AuthCallbacks&, bool useTls);
 
+// nullptr disables session resume
+void
+rtsp_auth_set_session_resume(
+    RtspAuth*,
+    const std::shared_ptr<SessionResume>&);
+
 G_END_DECLS
 
 }
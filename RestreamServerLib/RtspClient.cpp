@@ -0,0 +1,367 @@
+#include "RtspClient.h"
+
+#include <map>
+
+#include <CxxPtr/GlibPtr.h>
+
+#include "Log.h"
+#include "RtspPlayMedia.h"
+#include "RtspMountPoints.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+struct ResumeToken
+{
+    std::string token;
+    // prepared once more while token is valid,
+    // so it's not torn down when the last player leaves
+    GstRTSPMedia* media;
+};
+
+struct CxxPrivate
+{
+    ~CxxPrivate()
+    {
+        // normally handed over to mount points on close
+        for(const auto& pair: resumeTokens) {
+            if(GstRTSPMedia* media = pair.second.media) {
+                gst_rtsp_media_unprepare(media);
+                g_object_unref(media);
+            }
+        }
+    }
+
+    std::shared_ptr<SessionResume> sessionResume;
+    // the latest token issued for path
+    std::map<std::string, ResumeToken> resumeTokens;
+
+    std::shared_ptr<PathDirectory> pathDirectory;
+    std::string redirectLocation;
+};
+
+}
+
+struct _RtspClient
+{
+    GstRTSPClient parent_instance;
+
+    CxxPrivate* p;
+};
+
+
+G_DEFINE_TYPE(
+    RtspClient,
+    rtsp_client,
+    GST_TYPE_RTSP_CLIENT)
+
+
+static GstSDPMessage*
+create_sdp(GstRTSPClient* client, GstRTSPMedia* media);
+static void
+send_message(
+    GstRTSPClient* client,
+    GstRTSPContext* ctx,
+    GstRTSPMessage* message,
+    gpointer userData);
+static void
+closed(GstRTSPClient* client, gpointer userData);
+#if GST_CHECK_VERSION(1, 12, 0)
+static GstRTSPStatusCode
+pre_describe(GstRTSPClient* client, GstRTSPContext* ctx, gpointer userData);
+#endif
+
+
+RtspClient*
+rtsp_client_new()
+{
+    return _RTSP_CLIENT(g_object_new(TYPE_RTSP_CLIENT, NULL));
+}
+
+void
+rtsp_client_set_session_resume(
+    RtspClient* self,
+    const std::shared_ptr<SessionResume>& sessionResume)
+{
+    self->p->sessionResume = sessionResume;
+}
+
+void
+rtsp_client_set_path_directory(
+    RtspClient* self,
+    const std::shared_ptr<PathDirectory>& pathDirectory)
+{
+    self->p->pathDirectory = pathDirectory;
+}
+
+static void
+rtsp_client_class_init(RtspClientClass* klass)
+{
+    GstRTSPClientClass* gst_client_klass =
+        GST_RTSP_CLIENT_CLASS(klass);
+
+    gst_client_klass->create_sdp = create_sdp;
+
+    GObjectClass* object_klass = G_OBJECT_CLASS(klass);
+    object_klass->finalize =
+        [] (GObject* object) {
+            RtspClient* self = _RTSP_CLIENT(object);
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_client_parent_class)->finalize(object);
+        };
+}
+
+static void
+rtsp_client_init(RtspClient* self)
+{
+    self->p = new CxxPrivate;
+
+    g_signal_connect(self, "send-message", G_CALLBACK(send_message), nullptr);
+    g_signal_connect(self, "closed", G_CALLBACK(closed), nullptr);
+#if GST_CHECK_VERSION(1, 12, 0)
+    g_signal_connect(self, "pre-describe-request", G_CALLBACK(pre_describe), nullptr);
+#endif
+}
+
+// SDP depends on server address the client is connected to,
+// so it's used as part of cache key
+static std::string
+server_ip(GstRTSPClient* client)
+{
+    GstRTSPConnection* connection = gst_rtsp_client_get_connection(client);
+    if(!connection)
+        return std::string();
+
+    GSocket* socket = gst_rtsp_connection_get_read_socket(connection);
+    if(!socket)
+        return std::string();
+
+    GSocketAddress* address = g_socket_get_local_address(socket, nullptr);
+    if(!address)
+        return std::string();
+
+    std::string ip;
+    if(G_IS_INET_SOCKET_ADDRESS(address)) {
+        GInetAddress* inetAddress =
+            g_inet_socket_address_get_address(G_INET_SOCKET_ADDRESS(address));
+        GCharPtr ipPtr(g_inet_address_to_string(inetAddress));
+        ip = ipPtr.get();
+    }
+
+    g_object_unref(address);
+
+    return ip;
+}
+
+static GstSDPMessage*
+create_sdp(GstRTSPClient* client, GstRTSPMedia* media)
+{
+    GstRTSPClientClass* parent_klass =
+        GST_RTSP_CLIENT_CLASS(rtsp_client_parent_class);
+
+    if(!_IS_RTSP_PLAY_MEDIA(media) || !gst_rtsp_media_is_shared(media))
+        return parent_klass->create_sdp(client, media);
+
+    RtspPlayMedia* playMedia = _RTSP_PLAY_MEDIA(media);
+
+    const std::string ip = server_ip(client);
+
+    unsigned generation = 0;
+    GstSDPMessage* sdp = rtsp_play_media_get_cached_sdp(playMedia, ip, &generation);
+    if(sdp) {
+        Log()->trace(
+            "Cached SDP used. client: {}",
+            static_cast<const void*>(client));
+        return sdp;
+    }
+
+    sdp = parent_klass->create_sdp(client, media);
+    if(sdp)
+        rtsp_play_media_cache_sdp(playMedia, ip, generation, sdp);
+
+    return sdp;
+}
+
+#if GST_CHECK_VERSION(1, 12, 0)
+// player is sent to node where path's publisher is,
+// the same path is served locally if directory doesn't know it
+static GstRTSPStatusCode
+pre_describe(GstRTSPClient* client, GstRTSPContext* ctx, gpointer /*userData*/)
+{
+    RtspClient* self = _RTSP_CLIENT(client);
+
+    PathDirectory* pathDirectory = self->p->pathDirectory.get();
+    if(!pathDirectory || !ctx->uri || ctx->uri->query)
+        return GST_RTSP_STS_OK;
+
+    const std::string location = pathDirectory->lookup(ctx->uri->abspath);
+    if(location.empty())
+        return GST_RTSP_STS_OK;
+
+    Log()->debug(
+        "Redirecting player. client: {}, location: {}",
+        static_cast<const void*>(client), location);
+
+    self->p->redirectLocation = location;
+
+    return GST_RTSP_STS_MOVED_TEMPORARILY;
+}
+#endif
+
+static void
+add_redirect_location(
+    RtspClient* self,
+    GstRTSPContext* ctx,
+    GstRTSPMessage* message)
+{
+    if(self->p->redirectLocation.empty() || ctx->method != GST_RTSP_DESCRIBE)
+        return;
+
+    GstRTSPStatusCode code = GST_RTSP_STS_INVALID;
+    gst_rtsp_message_parse_response(message, &code, nullptr, nullptr);
+    if(code == GST_RTSP_STS_MOVED_TEMPORARILY) {
+        gst_rtsp_message_add_header(
+            message, GST_RTSP_HDR_LOCATION,
+            self->p->redirectLocation.c_str());
+    }
+
+    self->p->redirectLocation.clear();
+}
+
+// media is already prepared for PLAY, so thread from pool is just stopped
+static GstRTSPMedia*
+hold_media(GstRTSPClient* client, GstRTSPContext* ctx)
+{
+    if(!ctx->media)
+        return nullptr;
+
+    GstRTSPThreadPool* threadPool = gst_rtsp_client_get_thread_pool(client);
+    GstRTSPThread* thread =
+        threadPool ?
+            gst_rtsp_thread_pool_get_thread(threadPool, GST_RTSP_THREAD_TYPE_MEDIA, ctx) :
+            nullptr;
+    if(threadPool)
+        g_object_unref(threadPool);
+    if(!thread)
+        return nullptr;
+
+    if(!gst_rtsp_media_prepare(ctx->media, thread))
+        return nullptr;
+
+    return GST_RTSP_MEDIA(g_object_ref(ctx->media));
+}
+
+static void
+send_message(
+    GstRTSPClient* client,
+    GstRTSPContext* ctx,
+    GstRTSPMessage* message,
+    gpointer /*userData*/)
+{
+    RtspClient* self = _RTSP_CLIENT(client);
+
+    if(ctx && gst_rtsp_message_get_type(message) == GST_RTSP_MESSAGE_RESPONSE)
+        add_redirect_location(self, ctx, message);
+
+    SessionResume* sessionResume = self->p->sessionResume.get();
+    if(!sessionResume || !ctx || !ctx->request || !ctx->uri)
+        return;
+
+    if(ctx->method != GST_RTSP_PLAY ||
+       gst_rtsp_message_get_type(message) != GST_RTSP_MESSAGE_RESPONSE)
+    {
+        return;
+    }
+
+    GstRTSPStatusCode code = GST_RTSP_STS_INVALID;
+    gst_rtsp_message_parse_response(message, &code, nullptr, nullptr);
+    if(code != GST_RTSP_STS_OK)
+        return;
+
+    const std::string path = ctx->uri->abspath;
+
+    gchar* requestToken = nullptr;
+    if(GST_RTSP_OK == gst_rtsp_message_get_header_by_name(
+        ctx->request, Private::SessionResumeHeader, &requestToken, 0) &&
+       sessionResume->consume(requestToken, client, path))
+    {
+        Log()->debug(
+            "Session resumed. client: {}, path: {}",
+            static_cast<const void*>(client), path);
+    }
+
+    // tokens are single use, so fresh one is issued on every PLAY
+    const gchar* user =
+        ctx->token ?
+            gst_rtsp_token_get_string(ctx->token, GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE) :
+            nullptr;
+    const std::string token = sessionResume->issue(user ? user : "", path);
+
+    auto it = self->p->resumeTokens.find(path);
+    if(it != self->p->resumeTokens.end()) {
+        sessionResume->revoke(it->second.token);
+        it->second.token = token;
+    } else {
+        self->p->resumeTokens.emplace(
+            path,
+            ResumeToken { token, hold_media(client, ctx) });
+    }
+
+    const std::string header =
+        fmt::format("{};timeout={}", token, sessionResume->window());
+    gst_rtsp_message_add_header_by_name(
+        message, Private::SessionResumeHeader, header.c_str());
+}
+
+static void
+closed(GstRTSPClient* client, gpointer /*userData*/)
+{
+    RtspClient* self = _RTSP_CLIENT(client);
+
+    SessionResume* sessionResume = self->p->sessionResume.get();
+    if(!sessionResume)
+        return;
+
+    // tokens claimed by this connection are spent
+    sessionResume->drop(client);
+
+    if(self->p->resumeTokens.empty())
+        return;
+
+    GstRTSPMountPoints* mountPoints = gst_rtsp_client_get_mount_points(client);
+
+    for(auto& pair: self->p->resumeTokens) {
+        const std::string& path = pair.first;
+        ResumeToken& resumeToken = pair.second;
+
+        sessionResume->release(resumeToken.token);
+
+        // keep path with it's prepared media alive, so resumed player
+        // will be attached to already running pipeline
+        if(mountPoints && _IS_RTSP_MOUNT_POINTS(mountPoints)) {
+            rtsp_mount_points_hold_path(
+                _RTSP_MOUNT_POINTS(mountPoints),
+                path,
+                sessionResume->window(),
+                resumeToken.media);
+        } else if(resumeToken.media) {
+            gst_rtsp_media_unprepare(resumeToken.media);
+            g_object_unref(resumeToken.media);
+        }
+        resumeToken.media = nullptr;
+    }
+
+    self->p->resumeTokens.clear();
+
+    if(mountPoints)
+        g_object_unref(mountPoints);
+}
+
+}
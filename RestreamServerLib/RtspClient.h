@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "SessionResume.h"
+#include "PathDirectory.h"
+
+
+namespace RestreamServerLib
+{
+
+G_BEGIN_DECLS
+
+#define TYPE_RTSP_CLIENT rtsp_client_get_type()
+G_DECLARE_FINAL_TYPE(
+    RtspClient,
+    rtsp_client,
+    ,
+    RTSP_CLIENT,
+    GstRTSPClient)
+
+RtspClient*
+rtsp_client_new();
+
+void
+rtsp_client_set_session_resume(
+    RtspClient*,
+    const std::shared_ptr<SessionResume>&);
+
+// DESCRIBE of path published on another node is redirected there
+void
+rtsp_client_set_path_directory(
+    RtspClient*,
+    const std::shared_ptr<PathDirectory>&);
+
+G_END_DECLS
+
+}
@@ -1,9 +1,13 @@
 #include "RtspMountPoints.h"
 
 #include <cassert>
+#include <cstring>
 
 #include <set>
 #include <map>
+#include <deque>
+#include <vector>
+#include <algorithm>
 
 #include <CxxPtr/GlibPtr.h>
 #include <CxxPtr/GstRtspServerPtr.h>
@@ -11,6 +15,8 @@
 #include "Log.h"
 #include "RtspRecordMediaFactory.h"
 #include "RtspPlayMediaFactory.h"
+#include "FrameThinning.h"
+#include "SubStreamSelector.h"
 #include "StaticSources.h"
 #include "Private.h"
 
@@ -21,15 +27,30 @@ namespace RestreamServerLib
 namespace
 {
 
+const gchar* FpsQueryPrefix = "fps=";
+
 struct CxxPrivate
 {
     MountPointsCallbacks callbacks;
-    std::string splashSource;
     unsigned maxPathsCount;
     unsigned maxClientsPerPath;
+    unsigned viewersPerShard = 0;
+    unsigned fecPercentage = 0;
 
     std::map<std::string, uint32_t> pathsRefs;
+    std::map<std::string, std::shared_ptr<Channel> > pathsChannels;
+    std::map<std::string, std::shared_ptr<Channel> > pathsSubChannels;
+    std::map<std::string, std::unique_ptr<SubStreamSelector> > pathsPreviews;
+    std::map<std::string, std::map<unsigned, std::unique_ptr<FrameThinning> > > pathsFpsVariants;
+    // aggregate mount path -> it's tiles paths
+    std::map<std::string, std::vector<std::string> > tilesAggregates;
     std::map<GstRTSPClient*, std::set<std::string> > clientsToPaths;
+
+    // pinned paths with their prepared play media (nullptr if prepare failed)
+    std::map<std::string, GstRTSPMedia*> persistentPaths;
+
+    std::deque<GstRTSPClient*> closedClients;
+    GSource* closedClientsSource = nullptr;
 };
 
 }
@@ -38,8 +59,6 @@ struct _RtspMountPoints
 {
     GstRTSPMountPoints parent_instance;
 
-    uint64_t proxy;
-
     CxxPrivate* p;
 };
 
@@ -52,12 +71,49 @@ G_DEFINE_TYPE(
 
 static gchar*
 make_path(GstRTSPMountPoints* mountPoints, const GstRTSPUrl* url);
+static void
+release_path(
+    RtspMountPoints* self,
+    const std::string& path,
+    uint32_t refs);
+static void
+mount_path(
+    RtspMountPoints* self,
+    const std::string& path);
+static bool
+mount_fps_variant(
+    RtspMountPoints* self,
+    const std::string& path,
+    unsigned fps);
+static GstRTSPMedia*
+prepare_play_media(
+    RtspMountPoints* self,
+    const std::string& path,
+    GstRTSPThreadPool* threadPool,
+    unsigned short port);
+static std::shared_ptr<Channel>
+preview_channel(
+    RtspMountPoints* self,
+    const std::string& path);
+
 
+// persistent paths are not limited
+static size_t
+dynamic_paths_count(const CxxPrivate& p)
+{
+    return p.pathsRefs.size() - p.persistentPaths.size();
+}
+
+// excluding pin reference of persistent path
+static uint32_t
+path_clients_count(const CxxPrivate& p, const std::string& path, uint32_t refs)
+{
+    return p.persistentPaths.find(path) == p.persistentPaths.end() ? refs : refs - 1;
+}
 
 RtspMountPoints*
 rtsp_mount_points_new(
     const MountPointsCallbacks& callbacks,
-    const std::string& splashSource,
     unsigned maxPathsCount,
     unsigned maxClientsPerPath)
 {
@@ -66,14 +122,180 @@ rtsp_mount_points_new(
 
     if(instance) {
         instance->p->callbacks = callbacks;
-        instance->p->splashSource = splashSource;
         instance->p->maxPathsCount = maxPathsCount;
-        instance->p->maxClientsPerPath = maxPathsCount;
+        instance->p->maxClientsPerPath = maxClientsPerPath;
     }
 
     return instance;
 }
 
+void
+rtsp_mount_points_hold_path(
+    RtspMountPoints* self,
+    const std::string& path,
+    unsigned seconds,
+    GstRTSPMedia* preparedMedia)
+{
+    CxxPrivate& p = *self->p;
+
+    auto pathRefsIt = p.pathsRefs.find(path);
+    if(pathRefsIt == p.pathsRefs.end()) {
+        if(preparedMedia) {
+            gst_rtsp_media_unprepare(preparedMedia);
+            g_object_unref(preparedMedia);
+        }
+        return;
+    }
+
+    ++(pathRefsIt->second);
+
+    Log()->debug(
+        "Path held. path: {}, refs: {}, seconds: {}",
+        path, pathRefsIt->second, seconds);
+
+    struct Hold
+    {
+        RtspMountPoints* self;
+        std::string path;
+        GstRTSPMedia* media;
+    };
+
+    Hold* hold = new Hold;
+    hold->self = _RTSP_MOUNT_POINTS(g_object_ref(self));
+    hold->path = path;
+    hold->media = preparedMedia;
+
+    GSource* source = g_timeout_source_new_seconds(seconds);
+    g_source_set_callback(
+        source,
+        [] (gpointer userData) -> gboolean {
+            Hold* hold = static_cast<Hold*>(userData);
+            release_path(hold->self, hold->path, 1);
+            return G_SOURCE_REMOVE;
+        },
+        hold,
+        [] (gpointer userData) {
+            Hold* hold = static_cast<Hold*>(userData);
+            if(hold->media) {
+                gst_rtsp_media_unprepare(hold->media);
+                g_object_unref(hold->media);
+            }
+            g_object_unref(hold->self);
+            delete hold;
+        });
+    g_source_attach(source, g_main_context_get_thread_default());
+    g_source_unref(source);
+}
+
+bool
+rtsp_mount_points_acquire_path(
+    RtspMountPoints* self,
+    const std::string& path)
+{
+    CxxPrivate& p = *self->p;
+
+    if(rtsp_mount_points_ref_path(self, path))
+        return true;
+
+    if(p.maxPathsCount > 0 && dynamic_paths_count(p) >= p.maxPathsCount) {
+        Log()->info(
+            "Max paths count reached. path: {}, count {}",
+            path, p.maxPathsCount);
+        return false;
+    }
+
+    Log()->debug("Creating mount point. path: {}", path);
+
+    mount_path(self, path);
+
+    return true;
+}
+
+bool
+rtsp_mount_points_add_persistent_path(
+    RtspMountPoints* self,
+    const std::string& path,
+    GstRTSPThreadPool* threadPool,
+    unsigned short port)
+{
+    CxxPrivate& p = *self->p;
+
+    if(p.persistentPaths.end() != p.persistentPaths.find(path))
+        return true;
+
+    // the first reference is pin and is never released
+    if(!rtsp_mount_points_ref_path(self, path)) {
+        Log()->debug("Creating persistent mount point. path: {}", path);
+        mount_path(self, path);
+    }
+
+    GstRTSPMedia* media = prepare_play_media(self, path, threadPool, port);
+    p.persistentPaths.emplace(path, media);
+
+    if(!media) {
+        Log()->error("Fail to prepare persistent path media. path: {}", path);
+        return false;
+    }
+
+    Log()->info("Persistent path prepared. path: {}", path);
+
+    return true;
+}
+
+bool
+rtsp_mount_points_ref_path(
+    RtspMountPoints* self,
+    const std::string& path)
+{
+    auto pathRefsIt = self->p->pathsRefs.find(path);
+    if(pathRefsIt == self->p->pathsRefs.end())
+        return false;
+
+    ++(pathRefsIt->second);
+
+    Log()->debug(
+        "Path referenced. path: {}, refs: {}",
+        path, pathRefsIt->second);
+
+    return true;
+}
+
+void
+rtsp_mount_points_unref_path(
+    RtspMountPoints* self,
+    const std::string& path)
+{
+    release_path(self, path, 1);
+}
+
+std::shared_ptr<Channel>
+rtsp_mount_points_get_channel(
+    RtspMountPoints* self,
+    const std::string& path)
+{
+    auto it = self->p->pathsChannels.find(path);
+    if(it == self->p->pathsChannels.end())
+        return nullptr;
+
+    return it->second;
+}
+
+void
+rtsp_mount_points_set_viewers_per_shard(
+    RtspMountPoints* self,
+    unsigned viewersPerShard)
+{
+    self->p->viewersPerShard = viewersPerShard;
+}
+
+void
+rtsp_mount_points_set_fec_overhead(
+    RtspMountPoints* self,
+    unsigned percentage)
+{
+    self->p->fecPercentage = percentage;
+}
+
 static void
 rtsp_mount_points_class_init(RtspMountPointsClass* klass)
 {
@@ -86,6 +308,18 @@ rtsp_mount_points_class_init(RtspMountPointsClass* klass)
     object_klass->finalize =
         [] (GObject* object) {
             RtspMountPoints* self = _RTSP_MOUNT_POINTS(object);
+
+            Private::DestroySource(&self->p->closedClientsSource);
+            for(GstRTSPClient* client: self->p->closedClients)
+                g_object_unref(client);
+
+            for(const auto& pair: self->p->persistentPaths) {
+                if(!pair.second)
+                    continue;
+                gst_rtsp_media_unprepare(pair.second);
+                g_object_unref(pair.second);
+            }
+
             delete self->p;
             self->p = nullptr;
 
@@ -96,51 +330,392 @@ rtsp_mount_points_class_init(RtspMountPointsClass* klass)
 static void
 rtsp_mount_points_init(RtspMountPoints* self)
 {
-    self->proxy = 0;
     self->p = new CxxPrivate;
 }
 
+// adds play and record factories for path with single reference
 static void
-client_closed(GstRTSPClient* client, gpointer userData)
+mount_path(
+    RtspMountPoints* self,
+    const std::string& path)
 {
-    RtspMountPoints* self = _RTSP_MOUNT_POINTS(userData);
+    CxxPrivate& p = *self->p;
+    GstRTSPMountPoints* mountPoints = GST_RTSP_MOUNT_POINTS(self);
+
+    const std::shared_ptr<Channel> channel = std::make_shared<Channel>();
+    if(p.callbacks.maxKeyframeAge)
+        channel->setKeyframePolicy(p.callbacks.maxKeyframeAge(path));
+
+    RtspPlayMediaFactory* playFactory =
+        rtsp_play_media_factory_new(channel);
+    rtsp_play_media_factory_set_viewers_per_shard(
+        playFactory, p.viewersPerShard);
+    rtsp_play_media_factory_set_fec_overhead(
+        playFactory, p.fecPercentage);
+    RtspRecordMediaFactory* recordFactory =
+        rtsp_record_media_factory_new(channel);
+    if(p.callbacks.ingestLatency) {
+        gst_rtsp_media_factory_set_latency(
+            GST_RTSP_MEDIA_FACTORY(recordFactory),
+            p.callbacks.ingestLatency(path));
+    }
+
+    gst_rtsp_mount_points_add_factory(
+        mountPoints, path.c_str(), GST_RTSP_MEDIA_FACTORY(playFactory));
+    const std::string recordPath = path + "?" + Private::RecordSuffix;
+    gst_rtsp_mount_points_add_factory(
+        mountPoints, recordPath.c_str(), GST_RTSP_MEDIA_FACTORY(recordFactory));
 
+    p.pathsRefs.emplace(path, 1);
+    p.pathsChannels.emplace(path, channel);
+}
+
+// constructs shared play media the same way the first player of path would,
+// and keeps it prepared, so it's never torn down on last player leave
+static GstRTSPMedia*
+prepare_play_media(
+    RtspMountPoints* self,
+    const std::string& path,
+    GstRTSPThreadPool* threadPool,
+    unsigned short port)
+{
+    GstRTSPMediaFactory* factory =
+        gst_rtsp_mount_points_match(GST_RTSP_MOUNT_POINTS(self), path.c_str(), nullptr);
+    if(!factory)
+        return nullptr;
+
+    // players have to use the same port since it's part of media key
+    const std::string uri =
+        "rtsp://127.0.0.1:" + std::to_string(port) + path;
+    GstRTSPUrl* url = nullptr;
+    if(GST_RTSP_OK != gst_rtsp_url_parse(uri.c_str(), &url)) {
+        g_object_unref(factory);
+        return nullptr;
+    }
+
+    GstRTSPMedia* media = gst_rtsp_media_factory_construct(factory, url);
+    gst_rtsp_url_free(url);
+    g_object_unref(factory);
+    if(!media)
+        return nullptr;
+
+    GstRTSPContext context = GstRTSPContext();
+    GstRTSPThread* thread =
+        gst_rtsp_thread_pool_get_thread(
+            threadPool, GST_RTSP_THREAD_TYPE_MEDIA, &context);
+    if(!thread || !gst_rtsp_media_prepare(media, thread)) {
+        g_object_unref(media);
+        return nullptr;
+    }
+
+    return media;
+}
+
+// "sub" or "record&sub" optionally followed by "/control" of SETUP url
+static bool
+parse_sub_query(const gchar* query, bool* record, const gchar** rest)
+{
+    if(!query)
+        return false;
+
+    const gchar* end = nullptr;
+    if(g_str_has_prefix(query, Private::SubRecordSuffix)) {
+        *record = true;
+        end = query + strlen(Private::SubRecordSuffix);
+    } else if(g_str_has_prefix(query, Private::SubSuffix)) {
+        *record = false;
+        end = query + strlen(Private::SubSuffix);
+    } else
+        return false;
+
+    if(*end != '\0' && *end != '/')
+        return false;
+
+    if(rest)
+        *rest = end;
+
+    return true;
+}
+
+// mounts record factory for sub stream of path,
+// it lives while path is mounted
+static std::shared_ptr<Channel>
+sub_channel(
+    RtspMountPoints* self,
+    const std::string& path)
+{
     CxxPrivate& p = *self->p;
 
-    auto clientPathsIt = p.clientsToPaths.find(client);
-    if(clientPathsIt == p.clientsToPaths.end()) {
-        Log()->debug(
-            "Client didn't use any path. client: {}",
-            static_cast<const void*>(client));
+    if(p.pathsChannels.end() == p.pathsChannels.find(path))
+        return nullptr;
+
+    std::shared_ptr<Channel>& channel = p.pathsSubChannels[path];
+    if(channel)
+        return channel;
+
+    Log()->debug("Creating sub stream mount point. path: {}", path);
+
+    channel = std::make_shared<Channel>();
+    if(p.callbacks.maxKeyframeAge)
+        channel->setKeyframePolicy(p.callbacks.maxKeyframeAge(path));
+
+    RtspRecordMediaFactory* recordFactory =
+        rtsp_record_media_factory_new(channel);
+    if(p.callbacks.ingestLatency) {
+        gst_rtsp_media_factory_set_latency(
+            GST_RTSP_MEDIA_FACTORY(recordFactory),
+            p.callbacks.ingestLatency(path));
+    }
+
+    const std::string recordPath = path + "?" + Private::SubRecordSuffix;
+    gst_rtsp_mount_points_add_factory(
+        GST_RTSP_MOUNT_POINTS(self),
+        recordPath.c_str(),
+        GST_RTSP_MEDIA_FACTORY(recordFactory));
+
+    return channel;
+}
+
+// returns sub stream of path while it's published and main stream otherwise,
+// mounts play factory streaming it as well,
+// it lives while path is mounted
+static std::shared_ptr<Channel>
+preview_channel(
+    RtspMountPoints* self,
+    const std::string& path)
+{
+    CxxPrivate& p = *self->p;
+
+    auto previewIt = p.pathsPreviews.find(path);
+    if(previewIt != p.pathsPreviews.end())
+        return previewIt->second->output();
+
+    auto channelIt = p.pathsChannels.find(path);
+    if(channelIt == p.pathsChannels.end())
+        return nullptr;
+
+    const std::shared_ptr<Channel> subChannel = sub_channel(self, path);
+    std::unique_ptr<SubStreamSelector> selector =
+        SubStreamSelector::create(channelIt->second, subChannel);
+    if(!selector)
+        return channelIt->second;
+
+    Log()->debug("Creating preview. path: {}", path);
+
+    RtspPlayMediaFactory* playFactory =
+        rtsp_play_media_factory_new(selector->output());
+    rtsp_play_media_factory_set_viewers_per_shard(
+        playFactory, p.viewersPerShard);
+    rtsp_play_media_factory_set_fec_overhead(
+        playFactory, p.fecPercentage);
+
+    const std::string previewPath = path + "?" + Private::SubSuffix;
+    gst_rtsp_mount_points_add_factory(
+        GST_RTSP_MOUNT_POINTS(self),
+        previewPath.c_str(),
+        GST_RTSP_MEDIA_FACTORY(playFactory));
+
+    const std::shared_ptr<Channel> output = selector->output();
+    p.pathsPreviews.emplace(path, std::move(selector));
+
+    return output;
+}
+
+static std::string
+fps_variant_path(const std::string& path, unsigned fps)
+{
+    return path + "?" + FpsQueryPrefix + std::to_string(fps);
+}
+
+// "fps=N" optionally followed by "/control" of SETUP url
+static bool
+parse_fps_query(const gchar* query, unsigned* fps, const gchar** rest)
+{
+    if(!query || !g_str_has_prefix(query, FpsQueryPrefix))
+        return false;
+
+    const gchar* value = query + strlen(FpsQueryPrefix);
+    gchar* end = nullptr;
+    const guint64 parsed = g_ascii_strtoull(value, &end, 10);
+    if(end == value || (*end != '\0' && *end != '/'))
+        return false;
+
+    if(parsed == 0 || parsed > FrameThinning::MaxFps)
+        return false;
+
+    *fps = static_cast<unsigned>(parsed);
+    if(rest)
+        *rest = end;
+
+    return true;
+}
+
+// mounts play factory streaming path's channel thinned to fps,
+// it's shared by all players of the variant and lives while path is mounted
+static bool
+mount_fps_variant(
+    RtspMountPoints* self,
+    const std::string& path,
+    unsigned fps)
+{
+    CxxPrivate& p = *self->p;
+
+    // low frame rate viewers don't need high resolution either
+    const std::shared_ptr<Channel> source = preview_channel(self, path);
+    if(!source)
+        return false;
+
+    std::unique_ptr<FrameThinning>& thinning = p.pathsFpsVariants[path][fps];
+    if(thinning)
+        return true;
+
+    thinning = FrameThinning::create(source, fps);
+    if(!thinning) {
+        p.pathsFpsVariants[path].erase(fps);
+        return false;
+    }
+
+    Log()->debug("Creating fps variant. path: {}, fps: {}", path, fps);
+
+    RtspPlayMediaFactory* playFactory =
+        rtsp_play_media_factory_new(thinning->output());
+    rtsp_play_media_factory_set_viewers_per_shard(
+        playFactory, p.viewersPerShard);
+    rtsp_play_media_factory_set_fec_overhead(
+        playFactory, p.fecPercentage);
+
+    gst_rtsp_mount_points_add_factory(
+        GST_RTSP_MOUNT_POINTS(self),
+        fps_variant_path(path, fps).c_str(),
+        GST_RTSP_MEDIA_FACTORY(playFactory));
+
+    return true;
+}
+
+static void
+release_path(
+    RtspMountPoints* self,
+    const std::string& path,
+    uint32_t refs)
+{
+    CxxPrivate& p = *self->p;
+
+    auto pathRefsIt = p.pathsRefs.find(path);
+    if(pathRefsIt == p.pathsRefs.end() || pathRefsIt->second < refs) {
+        Log()->critical("Inconsistent data in mount points reference counting");
         return;
-    } else {
-        for(const std::string& path: clientPathsIt->second) {
-            auto pathRefsIt = p.pathsRefs.find(path);
-            if(pathRefsIt == p.pathsRefs.end())
-                Log()->critical("Inconsistent data in mount points reference counting");
-            else {
-                --pathRefsIt->second;
-                if(0 == pathRefsIt->second) {
-                    Log()->debug(
-                        "Removing unused mount point. last client: {}, path: {}",
-                        static_cast<const void*>(client), path);
-                    gst_rtsp_mount_points_remove_factory(
-                        GST_RTSP_MOUNT_POINTS(self),
-                        path.data());
-                    const std::string recordPath = path + Private::RecordSuffix;
-                    gst_rtsp_mount_points_remove_factory(
-                        GST_RTSP_MOUNT_POINTS(self),
-                        recordPath.data());
-                    p.pathsRefs.erase(pathRefsIt);
-                } else {
-                    Log()->debug(
-                        "Path ref count decreased. client: {}, path: {}, refs: {}",
-                        static_cast<const void*>(client), path, pathRefsIt->second);
-                }
+    }
+
+    pathRefsIt->second -= refs;
+    if(0 == pathRefsIt->second) {
+        Log()->debug(
+            "Removing unused mount point. path: {}",
+            path);
+        gst_rtsp_mount_points_remove_factory(
+            GST_RTSP_MOUNT_POINTS(self),
+            path.data());
+        const std::string recordPath =
+            path + "?" + Private::RecordSuffix;
+        gst_rtsp_mount_points_remove_factory(
+            GST_RTSP_MOUNT_POINTS(self),
+            recordPath.data());
+        auto variantsIt = p.pathsFpsVariants.find(path);
+        if(variantsIt != p.pathsFpsVariants.end()) {
+            for(const auto& pair: variantsIt->second) {
+                gst_rtsp_mount_points_remove_factory(
+                    GST_RTSP_MOUNT_POINTS(self),
+                    fps_variant_path(path, pair.first).c_str());
             }
+            p.pathsFpsVariants.erase(variantsIt);
+        }
+        for(auto it = p.tilesAggregates.begin(); it != p.tilesAggregates.end();) {
+            const std::vector<std::string>& tiles = it->second;
+            if(tiles.end() != std::find(tiles.begin(), tiles.end(), path)) {
+                gst_rtsp_mount_points_remove_factory(
+                    GST_RTSP_MOUNT_POINTS(self),
+                    it->first.c_str());
+                it = p.tilesAggregates.erase(it);
+            } else
+                ++it;
+        }
+        if(p.pathsPreviews.erase(path)) {
+            const std::string previewPath =
+                path + "?" + Private::SubSuffix;
+            gst_rtsp_mount_points_remove_factory(
+                GST_RTSP_MOUNT_POINTS(self),
+                previewPath.c_str());
+        }
+        if(p.pathsSubChannels.erase(path)) {
+            const std::string subRecordPath =
+                path + "?" + Private::SubRecordSuffix;
+            gst_rtsp_mount_points_remove_factory(
+                GST_RTSP_MOUNT_POINTS(self),
+                subRecordPath.c_str());
+        }
+        p.pathsRefs.erase(pathRefsIt);
+        p.pathsChannels.erase(path);
+    } else {
+        Log()->debug(
+            "Path ref count decreased. path: {}, refs: {}",
+            path, pathRefsIt->second);
+    }
+}
+
+static gboolean
+cleanup_closed_clients(gpointer userData)
+{
+    RtspMountPoints* self = _RTSP_MOUNT_POINTS(userData);
+
+    CxxPrivate& p = *self->p;
+
+    // coalesce path references released by the whole batch
+    std::map<std::string, uint32_t> releasedRefs;
+    for(unsigned i = 0;
+        i < Private::ClosedClientsBatchSize && !p.closedClients.empty();
+        ++i)
+    {
+        GstRTSPClient* client = p.closedClients.front();
+        p.closedClients.pop_front();
+
+        auto clientPathsIt = p.clientsToPaths.find(client);
+        if(clientPathsIt == p.clientsToPaths.end()) {
+            Log()->debug(
+                "Client didn't use any path. client: {}",
+                static_cast<const void*>(client));
+        } else {
+            for(const std::string& path: clientPathsIt->second)
+                ++releasedRefs[path];
+            p.clientsToPaths.erase(clientPathsIt);
         }
-        p.clientsToPaths.erase(clientPathsIt);
+
+        g_object_unref(client);
     }
+
+    for(const auto& pair: releasedRefs)
+        release_path(self, pair.first, pair.second);
+
+    if(p.closedClients.empty()) {
+        g_source_unref(p.closedClientsSource);
+        p.closedClientsSource = nullptr;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+client_closed(GstRTSPClient* client, gpointer userData)
+{
+    RtspMountPoints* self = _RTSP_MOUNT_POINTS(userData);
+
+    CxxPrivate& p = *self->p;
+
+    // cleanup is postponed to let mass disconnects be handled in batches,
+    // reference is kept to not let client address be reused meanwhile
+    p.closedClients.push_back(GST_RTSP_CLIENT(g_object_ref(client)));
+
+    if(!p.closedClientsSource)
+        p.closedClientsSource = Private::AttachIdle(cleanup_closed_clients, self);
 }
 
 static bool
@@ -150,13 +725,21 @@ authorize_access(
     const GstRTSPUrl* url)
 {
     bool record = false;
-    if(url->query != nullptr ) {
+    std::vector<std::string> paths;
+    if(Private::ParseTilesUrl(url, &paths)) {
+        // every tile is authorized as if it was requested alone
+    } else if(url->query != nullptr ) {
+        unsigned fps;
         if(0 == g_strcmp0(url->query, Private::RecordSuffix))
             record = true;
-        else
+        else if(!parse_sub_query(url->query, &record, nullptr) &&
+                !parse_fps_query(url->query, &fps, nullptr))
             return false;
     }
 
+    if(paths.empty())
+        paths.push_back(url->abspath);
+
     if(self->p->callbacks.authorizeAccess) {
         const gchar* user = nullptr;
         if(context->token) {
@@ -166,105 +749,228 @@ authorize_access(
                     GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE);
         }
 
-        return
-            self->p->callbacks.authorizeAccess(
-                user ? user : "",
-                url->abspath,
-                record);
-    } else
-        return true;
+        for(const std::string& path: paths) {
+            if(!self->p->callbacks.authorizeAccess(user ? user : "", path, record))
+                return false;
+        }
+    }
+
+    return true;
 }
 
-static gchar*
-make_path(GstRTSPMountPoints* mountPoints, const GstRTSPUrl* url)
+// mounts play factory streaming all tiles in one media,
+// it lives while all tiles are mounted
+static bool
+mount_tiles(
+    RtspMountPoints* self,
+    const std::string& aggregatePath,
+    const std::vector<std::string>& tiles)
 {
-    RtspMountPoints* self = _RTSP_MOUNT_POINTS(mountPoints);
+    CxxPrivate& p = *self->p;
 
-    GstRTSPContext* context = gst_rtsp_context_get_current();
-    assert(context);
-    if(!context)
-        return nullptr;
+    if(p.tilesAggregates.end() != p.tilesAggregates.find(aggregatePath))
+        return true;
 
-    if(!authorize_access(self, context, url))
-        return nullptr;
+    // tiles are small, so sub streams are used if published
+    std::vector<std::shared_ptr<Channel> > channels;
+    for(const std::string& tile: tiles) {
+        const std::shared_ptr<Channel> channel = preview_channel(self, tile);
+        if(!channel)
+            return false;
 
-    const std::string path = url->abspath;
-    const bool isRecord = (g_strcmp0(url->query, "record") == 0);
+        channels.push_back(channel);
+    }
 
-    Log()->debug("make_path. client: {}, path: {}",
-        static_cast<const void*>(context->client), path);
+    Log()->debug(
+        "Creating tiles aggregate. path: {}, tiles: {}",
+        aggregatePath, tiles.size());
+
+    RtspPlayMediaFactory* playFactory =
+        rtsp_play_media_factory_new_aggregate(channels);
+    rtsp_play_media_factory_set_viewers_per_shard(
+        playFactory, p.viewersPerShard);
+    rtsp_play_media_factory_set_fec_overhead(
+        playFactory, p.fecPercentage);
+
+    gst_rtsp_mount_points_add_factory(
+        GST_RTSP_MOUNT_POINTS(self),
+        aggregatePath.c_str(),
+        GST_RTSP_MEDIA_FACTORY(playFactory));
 
+    p.tilesAggregates.emplace(aggregatePath, tiles);
+
+    return true;
+}
+
+// client references every path only once for it's whole life,
+// path is mounted on the first reference,
+// returns false if limits are reached
+static bool
+reference_client_path(
+    RtspMountPoints* self,
+    GstRTSPClient* client,
+    const std::string& path)
+{
     CxxPrivate& p = *self->p;
 
+    auto clientPathsIt = p.clientsToPaths.find(client);
+    const bool newClient = clientPathsIt == p.clientsToPaths.end();
+    // client references every path only once
+    const bool addPathRef =
+        newClient || clientPathsIt->second.end() == clientPathsIt->second.find(path);
+
     auto pathRefsIt = p.pathsRefs.find(path);
-    if(self->p->maxPathsCount > 0 &&
+    if(addPathRef &&
+       self->p->maxPathsCount > 0 &&
        pathRefsIt == p.pathsRefs.end() &&
-       p.pathsRefs.size() >= self->p->maxPathsCount)
+       dynamic_paths_count(p) >= self->p->maxPathsCount)
     {
         Log()->info(
             "Max paths count reached. client: {}, path: {}, count {}",
-            static_cast<const void*>(context->client), path, self->p->maxPathsCount);
+            static_cast<const void*>(client), path, self->p->maxPathsCount);
 
-        return nullptr;
+        return false;
     }
 
-    if(self->p->maxClientsPerPath > 0 &&
+    if(addPathRef &&
+       self->p->maxClientsPerPath > 0 &&
        pathRefsIt != p.pathsRefs.end() &&
-       pathRefsIt->second >= self->p->maxClientsPerPath)
+       path_clients_count(p, path, pathRefsIt->second) >= self->p->maxClientsPerPath)
     {
         Log()->info(
             "Max clients count per path reached. client: {}, path: {}, count {}",
-            static_cast<const void*>(context->client), path, self->p->maxClientsPerPath);
+            static_cast<const void*>(client), path, self->p->maxClientsPerPath);
 
-        return nullptr;
+        return false;
     }
 
-    bool addPathRef = false;
-    auto clientPathsIt = p.clientsToPaths.find(context->client);
-    if(clientPathsIt == p.clientsToPaths.end()) {
+    if(newClient) {
         Log()->debug(
             "Path request from new client. client: {}, path: {}",
-            static_cast<const void*>(context->client), path);
+            static_cast<const void*>(client), path);
 
-        g_signal_connect(context->client, "closed", GCallback(client_closed), mountPoints);
-        p.clientsToPaths.emplace(context->client, std::set<std::string>{path});
-        addPathRef = true;
+        g_signal_connect(client, "closed", GCallback(client_closed), self);
+        p.clientsToPaths.emplace(client, std::set<std::string>{path});
     } else {
         Log()->debug(
             "Client requesting path. client: {}, path: {}",
-            static_cast<const void*>(context->client), path);
-        addPathRef = clientPathsIt->second.insert(path).second;
+            static_cast<const void*>(client), path);
+        clientPathsIt->second.insert(path);
     }
 
     if(p.pathsRefs.end() == pathRefsIt) {
         Log()->debug(
             "Creating mount point. client: {}, path: {}",
-            static_cast<const void*>(context->client), path);
+            static_cast<const void*>(client), path);
 
         assert(addPathRef);
 
-        const std::string proxyName =
-            fmt::format("proxy{}", self->proxy++);
-
-        RtspPlayMediaFactory* playFactory =
-            rtsp_play_media_factory_new(
-                self->p->splashSource.c_str(),
-                proxyName.c_str());
-        RtspRecordMediaFactory* recordFactory =
-            rtsp_record_media_factory_new(proxyName.c_str());
-
-        gst_rtsp_mount_points_add_factory(
-            mountPoints, url->abspath, GST_RTSP_MEDIA_FACTORY(playFactory));
-        GCharPtr recordUrl(g_strconcat(url->abspath, "?", Private::RecordSuffix, nullptr));
-        gst_rtsp_mount_points_add_factory(
-            mountPoints, recordUrl.get(), GST_RTSP_MEDIA_FACTORY(recordFactory));
-
-        p.pathsRefs.emplace(path, 1);
-    } else {
+        mount_path(self, path);
+    } else if(addPathRef) {
         ++(pathRefsIt->second);
         Log()->debug(
             "Path ref count increased. client: {}, path: {}, refs: {}",
-            static_cast<const void*>(context->client), path, pathRefsIt->second);
+            static_cast<const void*>(client), path, pathRefsIt->second);
+    }
+
+    return true;
+}
+
+// every tile is referenced by client as if it was requested alone
+static gchar*
+make_tiles_path(
+    RtspMountPoints* self,
+    GstRTSPClient* client,
+    const GstRTSPUrl* url,
+    const std::vector<std::string>& tiles)
+{
+    CxxPrivate& p = *self->p;
+
+    for(const std::string& tile: tiles) {
+        if(!reference_client_path(self, client, tile))
+            return nullptr;
+
+        auto channelIt = p.pathsChannels.find(tile);
+        if(channelIt != p.pathsChannels.end())
+            channelIt->second->requestKeyframe();
+        auto subChannelIt = p.pathsSubChannels.find(tile);
+        if(subChannelIt != p.pathsSubChannels.end())
+            subChannelIt->second->requestKeyframe();
+    }
+
+    const std::string aggregatePath =
+        std::string(url->abspath) + "?" + Private::TilesSuffix;
+    if(!mount_tiles(self, aggregatePath, tiles))
+        return nullptr;
+
+    // "/control" of SETUP url
+    const gchar* rest = url->query + strlen(Private::TilesSuffix);
+
+    return g_strdup((aggregatePath + rest).c_str());
+}
+
+static gchar*
+make_path(GstRTSPMountPoints* mountPoints, const GstRTSPUrl* url)
+{
+    RtspMountPoints* self = _RTSP_MOUNT_POINTS(mountPoints);
+
+    GstRTSPContext* context = gst_rtsp_context_get_current();
+    assert(context);
+    if(!context)
+        return nullptr;
+
+    if(!authorize_access(self, context, url))
+        return nullptr;
+
+    std::vector<std::string> tiles;
+    if(Private::ParseTilesUrl(url, &tiles))
+        return make_tiles_path(self, context->client, url, tiles);
+
+    const std::string path = url->abspath;
+    const bool isRecord = (g_strcmp0(url->query, "record") == 0);
+    unsigned fps = 0;
+    const gchar* fpsRest = nullptr;
+    const bool isFpsVariant = parse_fps_query(url->query, &fps, &fpsRest);
+    bool isSubRecord = false;
+    const gchar* subRest = nullptr;
+    const bool isSub = parse_sub_query(url->query, &isSubRecord, &subRest);
+
+    Log()->debug("make_path. client: {}, path: {}",
+        static_cast<const void*>(context->client), path);
+
+    CxxPrivate& p = *self->p;
+
+    if(!reference_client_path(self, context->client, path))
+        return nullptr;
+
+    // new player of already running shared media
+    // would wait for next keyframe otherwise
+    if(!isRecord && !isSubRecord) {
+        auto channelIt = p.pathsChannels.find(path);
+        if(channelIt != p.pathsChannels.end())
+            channelIt->second->requestKeyframe();
+        auto subChannelIt = p.pathsSubChannels.find(path);
+        if(subChannelIt != p.pathsSubChannels.end())
+            subChannelIt->second->requestKeyframe();
+    }
+
+    if(isSub && isSubRecord) {
+        if(!sub_channel(self, path))
+            return nullptr;
+
+        return g_strdup((path + "?" + Private::SubRecordSuffix + subRest).c_str());
+    } else if(isSub) {
+        if(!preview_channel(self, path))
+            return nullptr;
+
+        return g_strdup((path + "?" + Private::SubSuffix + subRest).c_str());
+    }
+
+    if(isFpsVariant) {
+        if(!mount_fps_variant(self, path, fps))
+            return nullptr;
+
+        return g_strdup((fps_variant_path(path, fps) + fpsRest).c_str());
     }
 
     return
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <functional>
 
 #include <gst/rtsp-server/rtsp-server.h>
 
+#include "Channel.h"
+
 
 namespace RestreamServerLib
 {
@@ -11,6 +14,8 @@ namespace RestreamServerLib
 struct MountPointsCallbacks
 {
     std::function<bool (const std::string& user, const std::string& path, bool record)> authorizeAccess;
+    std::function<unsigned (const std::string& path)> ingestLatency;
+    std::function<unsigned (const std::string& path)> maxKeyframeAge;
 };
 
 G_BEGIN_DECLS
@@ -26,10 +31,67 @@ G_DECLARE_FINAL_TYPE(
 RtspMountPoints*
 rtsp_mount_points_new(
     const MountPointsCallbacks&,
-    const std::string& splashSource,
     unsigned maxPathsCount,
     unsigned maxClientsPerPath);
 
+// keeps path alive for specified time even if it isn't used by any client,
+// takes over reference and extra prepare of preparedMedia (if any)
+// and unprepares it when time is over,
+// so shared media isn't torn down meanwhile
+void
+rtsp_mount_points_hold_path(
+    RtspMountPoints*,
+    const std::string& path,
+    unsigned seconds,
+    GstRTSPMedia* preparedMedia);
+
+// mounts path if it's not mounted yet and references it,
+// returns false if max paths count is reached
+bool
+rtsp_mount_points_acquire_path(
+    RtspMountPoints*,
+    const std::string& path);
+
+// mounts path which is never unmounted and doesn't count against
+// max paths count, it's play media is constructed for url on port
+// and prepared on thread taken from pool beforehand,
+// so players don't wait for pipeline startup
+bool
+rtsp_mount_points_add_persistent_path(
+    RtspMountPoints*,
+    const std::string& path,
+    GstRTSPThreadPool*,
+    unsigned short port);
+
+// keeps path mounted until unref even if it isn't used by any client,
+// returns false if path is not mounted
+bool
+rtsp_mount_points_ref_path(
+    RtspMountPoints*,
+    const std::string& path);
+void
+rtsp_mount_points_unref_path(
+    RtspMountPoints*,
+    const std::string& path);
+
+// returns nullptr if path is not mounted
+std::shared_ptr<Channel>
+rtsp_mount_points_get_channel(
+    RtspMountPoints*,
+    const std::string& path);
+
+// applies to paths created after call
+void
+rtsp_mount_points_set_viewers_per_shard(
+    RtspMountPoints*,
+    unsigned viewersPerShard);
+
+// applies to paths created after call
+void
+rtsp_mount_points_set_fec_overhead(
+    RtspMountPoints*,
+    unsigned percentage);
+
 G_END_DECLS
 
 }
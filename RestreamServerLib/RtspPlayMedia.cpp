@@ -1,32 +1,87 @@
 #include "RtspPlayMedia.h"
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include <glib.h>
 
 #include <CxxPtr/GlibPtr.h>
 #include <CxxPtr/GstPtr.h>
 
 #include "Log.h"
+#include "Private.h"
+#include "Splash.h"
 
 
 namespace RestreamServerLib
 {
 
-struct _RtspPlayMedia
+namespace
 {
-    GstRTSPMedia parent_instance;
 
-    bool sourceSelected;
-    GstElement* selector;
+// viewer losing more than 5% of packets is considered congested
+const guint CongestedFractionLost = 256 * 5 / 100;
 
-    GstPad* selectorTestCardPad;
-    GstPad* selectorSourcePad;
+// every stream of media switches between it's own splash screen and source
+struct Tile
+{
+    bool sourceSelected = false;
+    GstElement* selector = nullptr;
 
-    GstPad* sourcePad;
+    GstPad* selectorTestCardPad = nullptr;
+    GstPad* selectorSourcePad = nullptr;
 
-    gulong sourcePadProbe;
-    guint checkTimeout;
+    GstPad* sourcePad = nullptr;
+
+    gulong sourcePadProbe = 0;
+
+    GstClockTime lastBufferTime = 0;
+};
+
+struct CxxPrivate
+{
+    ~CxxPrivate();
+
+    std::shared_ptr<Channel> channel;
 
-    GstClockTime lastBufferTime;
+    // filled on construction and never resized after
+    std::vector<Tile> tiles;
+
+    void clearSdpCache();
+
+    std::mutex sdpCacheMutex;
+    std::map<std::string, GstSDPMessage*> sdpCache;
+    // incremented on every clear, so SDP created before clear is not cached
+    unsigned sdpCacheGeneration = 0;
+};
+
+CxxPrivate::~CxxPrivate()
+{
+    clearSdpCache();
+}
+
+void CxxPrivate::clearSdpCache()
+{
+    std::lock_guard<std::mutex> lock(sdpCacheMutex);
+
+    for(auto& pair: sdpCache)
+        gst_sdp_message_free(pair.second);
+
+    sdpCache.clear();
+    ++sdpCacheGeneration;
+}
+
+}
+
+struct _RtspPlayMedia
+{
+    GstRTSPMedia parent_instance;
+
+    CxxPrivate* p;
+
+    guint checkTimeout;
+    guint healthTimeout;
 };
 
 
@@ -36,18 +91,89 @@ G_DEFINE_TYPE(
     GST_TYPE_RTSP_MEDIA)
 
 
+// splash matching source's caps lets players continue decoding on switch
+static void
+attach_splash(GstElement* splashElement, GstCaps* sourceCaps)
+{
+    std::shared_ptr<Splash> splash = Splash::acquire(sourceCaps);
+    if(!splash)
+        return;
+
+    std::shared_ptr<Splash>* currentSplash =
+        static_cast<std::shared_ptr<Splash>*>(
+            g_object_get_data(G_OBJECT(splashElement), "splash"));
+    if(currentSplash && *currentSplash == splash)
+        return;
+
+    Channel::reattachAppSrc(splash->channel(), splashElement);
+    // splash is kept alive while media uses it
+    g_object_set_data_full(
+        G_OBJECT(splashElement),
+        "splash",
+        new std::shared_ptr<Splash>(splash),
+        [] (gpointer userData) {
+            delete static_cast<std::shared_ptr<Splash>*>(userData);
+        });
+}
+
+static void
+attach_tile(
+    GstElement* element,
+    unsigned index,
+    const std::shared_ptr<Channel>& channel)
+{
+    const std::string splashName = fmt::format("splash{}", index);
+    GstElementPtr splashPtr(gst_bin_get_by_name(GST_BIN(element), splashName.c_str()));
+
+    std::shared_ptr<GWeakRef> splashRef;
+    if(splashPtr) {
+        GstCaps* sourceCaps = channel->caps();
+        attach_splash(splashPtr.get(), sourceCaps);
+        if(sourceCaps)
+            gst_caps_unref(sourceCaps);
+
+        splashRef.reset(
+            new GWeakRef,
+            [] (GWeakRef* weakRef) {
+                g_weak_ref_clear(weakRef);
+                delete weakRef;
+            });
+        g_weak_ref_init(splashRef.get(), splashPtr.get());
+    }
+
+    const std::string channelName = fmt::format("channel{}", index);
+    GstElementPtr appsrcPtr(gst_bin_get_by_name(GST_BIN(element), channelName.c_str()));
+    if(!appsrcPtr)
+        return;
+
+    // splash follows source's resolution, profile and frame rate changes
+    Channel::attachAppSrc(
+        channel,
+        appsrcPtr.get(),
+        [splashRef] (GstCaps* sourceCaps) {
+            if(!splashRef)
+                return;
+
+            GstElementPtr splashPtr(GST_ELEMENT(g_weak_ref_get(splashRef.get())));
+            if(splashPtr)
+                attach_splash(splashPtr.get(), sourceCaps);
+        });
+}
+
 GstElement*
 rtsp_play_media_create_element(
-    const URL& splashSource,
-    const std::string& listenTo)
+    const std::vector<std::shared_ptr<Channel> >& channels)
 {
-    const std::string pipeline =
-        fmt::format(
-           "rtspsrc name=src ! rtph264depay ! h264parse name=testCardParse ! selector. "
-           "interpipesrc format=time listen-to={} ! selector. "
-           "input-selector cache-buffers=true sync-mode=1 name=selector "
-           "selector. ! rtph264pay config-interval=-1 pt=96 name=pay0 ",
-           listenTo);
+    std::string pipeline;
+    for(unsigned i = 0; i < channels.size(); ++i) {
+        pipeline +=
+            fmt::format(
+                "appsrc name=splash{0} ! selector{0}. "
+                "appsrc name=channel{0} ! selector{0}. "
+                "input-selector cache-buffers=true sync-mode=1 name=selector{0} "
+                "selector{0}. ! rtph264pay config-interval=-1 pt=96 name=pay{0} ",
+                i);
+    }
 
     GError* error = nullptr;
     GstElement* element =
@@ -62,15 +188,79 @@ rtsp_play_media_create_element(
             errorPtr->message);
 
     if(element) {
-        GstElementPtr rtspsrcPtr(gst_bin_get_by_name(GST_BIN(element), "src"));
-        GstElement* rtspsrc = rtspsrcPtr.get();
-        if(rtspsrc)
-            g_object_set(rtspsrc, "location", splashSource.c_str(), NULL);
+        for(unsigned i = 0; i < channels.size(); ++i)
+            attach_tile(element, i, channels[i]);
     }
 
     return element;
 }
 
+void
+rtsp_play_media_set_channel(
+    RtspPlayMedia* self,
+    const std::shared_ptr<Channel>& channel)
+{
+    self->p->channel = channel;
+}
+
+GstSDPMessage*
+rtsp_play_media_get_cached_sdp(
+    RtspPlayMedia* self,
+    const std::string& serverIp,
+    unsigned* generation)
+{
+    std::lock_guard<std::mutex> lock(self->p->sdpCacheMutex);
+
+    *generation = self->p->sdpCacheGeneration;
+
+    auto it = self->p->sdpCache.find(serverIp);
+    if(it == self->p->sdpCache.end())
+        return nullptr;
+
+    GstSDPMessage* sdp = nullptr;
+    gst_sdp_message_copy(it->second, &sdp);
+
+    return sdp;
+}
+
+void
+rtsp_play_media_cache_sdp(
+    RtspPlayMedia* self,
+    const std::string& serverIp,
+    unsigned generation,
+    const GstSDPMessage* sdp)
+{
+    GstSDPMessage* sdpCopy = nullptr;
+    if(GST_SDP_OK != gst_sdp_message_copy(sdp, &sdpCopy))
+        return;
+
+    std::lock_guard<std::mutex> lock(self->p->sdpCacheMutex);
+
+    if(generation != self->p->sdpCacheGeneration) {
+        // cache was dropped while SDP was created, so SDP could be stale
+        gst_sdp_message_free(sdpCopy);
+        return;
+    }
+
+    GstSDPMessage*& cachedSdp = self->p->sdpCache[serverIp];
+    if(cachedSdp)
+        gst_sdp_message_free(cachedSdp);
+    cachedSdp = sdpCopy;
+}
+
+static void
+onPayCapsChanged(
+    GObject* /*pad*/,
+    GParamSpec* /*pspec*/,
+    gpointer userData)
+{
+    RtspPlayMedia* self = _RTSP_PLAY_MEDIA(userData);
+
+    Log()->debug("RtspPlayMedia. Payloader caps changed. Dropping SDP cache.");
+
+    self->p->clearSdpCache();
+}
+
 static void
 constructed(GObject* object)
 {
@@ -83,48 +273,65 @@ constructed(GObject* object)
     GstElementPtr pipelinePtr(gst_rtsp_media_get_element(selfMedia));
     GstElement* pipeline = pipelinePtr.get();
 
-    GstElementPtr selectorPtr(gst_bin_get_by_name(GST_BIN(pipeline), "selector"));
-    self->selector = selectorPtr.get(); // FIXME! should we keep ref?
+    for(unsigned i = 0; ; ++i) {
+        const std::string selectorName = fmt::format("selector{}", i);
+        GstElementPtr selectorPtr(gst_bin_get_by_name(GST_BIN(pipeline), selectorName.c_str()));
+        if(!selectorPtr)
+            break;
+
+        Tile tile;
+        tile.selector = selectorPtr.get(); // FIXME! should we keep ref?
 
-    GstElementPtr testCardParsePtr(gst_bin_get_by_name(GST_BIN(pipeline), "testCardParse"));
-    GstElement* testCardParse = testCardParsePtr.get();
+        const std::string splashName = fmt::format("splash{}", i);
+        GstElementPtr splashPtr(gst_bin_get_by_name(GST_BIN(pipeline), splashName.c_str()));
+        GstElement* splash = splashPtr.get();
 
-    GstPadPtr testCardParseSrcPadPtr(gst_element_get_static_pad(testCardParse, "src"));
-    GstPad* testCardParseSrcPad = testCardParseSrcPadPtr.get();
+        GstPadPtr splashSrcPadPtr(gst_element_get_static_pad(splash, "src"));
+        GstPad* splashSrcPad = splashSrcPadPtr.get();
 
-    GstPadPtr selectorTestCardPadPtr(gst_pad_get_peer(testCardParseSrcPad));
-    self->selectorTestCardPad = selectorTestCardPadPtr.get(); // FIXME! should we keep ref?
+        GstPadPtr selectorTestCardPadPtr(gst_pad_get_peer(splashSrcPad));
+        tile.selectorTestCardPad = selectorTestCardPadPtr.get(); // FIXME! should we keep ref?
 
 #if GST_CHECK_VERSION(1, 14, 0)
-    gst_element_foreach_sink_pad(self->selector,
-        [] (GstElement* /*element*/,
-            GstPad* pad,
-            gpointer userData) -> gboolean
-        {
-            RtspPlayMedia* selfMedia = static_cast<RtspPlayMedia*>(userData);
-            if(pad != selfMedia->selectorTestCardPad) {
-                selfMedia->selectorSourcePad = pad;
-                return FALSE;
-            }
-            return TRUE;
-        }, self);
+        gst_element_foreach_sink_pad(tile.selector,
+            [] (GstElement* /*element*/,
+                GstPad* pad,
+                gpointer userData) -> gboolean
+            {
+                Tile* tile = static_cast<Tile*>(userData);
+                if(pad != tile->selectorTestCardPad) {
+                    tile->selectorSourcePad = pad;
+                    return FALSE;
+                }
+                return TRUE;
+            }, &tile);
 #else
-    GstIterator* it = gst_element_iterate_sink_pads(self->selector);
-    GValue item = G_VALUE_INIT;
-    while(gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
-        GstPad* pad = GST_PAD(g_value_get_object(&item));
-        if(pad != self->selectorTestCardPad) {
-            self->selectorSourcePad = pad;
-            break;
+        GstIterator* it = gst_element_iterate_sink_pads(tile.selector);
+        GValue item = G_VALUE_INIT;
+        while(gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+            GstPad* pad = GST_PAD(g_value_get_object(&item));
+            if(pad != tile.selectorTestCardPad) {
+                tile.selectorSourcePad = pad;
+                break;
+            }
+            g_value_reset(&item);
         }
-        g_value_reset(&item);
-    }
-    g_value_unset(&item);
-    gst_iterator_free(it);
+        g_value_unset(&item);
+        gst_iterator_free(it);
 #endif
 
-    GstPadPtr sourcePadPtr(gst_pad_get_peer(self->selectorSourcePad));
-    self->sourcePad = sourcePadPtr.get(); // FIXME! should we keep ref?
+        GstPadPtr sourcePadPtr(gst_pad_get_peer(tile.selectorSourcePad));
+        tile.sourcePad = sourcePadPtr.get(); // FIXME! should we keep ref?
+
+        const std::string payName = fmt::format("pay{}", i);
+        GstElementPtr payPtr(gst_bin_get_by_name(GST_BIN(pipeline), payName.c_str()));
+        GstPadPtr paySrcPadPtr(gst_element_get_static_pad(payPtr.get(), "src"));
+        g_signal_connect_object(
+            paySrcPadPtr.get(), "notify::caps",
+            G_CALLBACK(onPayCapsChanged), self, GConnectFlags(0));
+
+        self->p->tiles.push_back(tile);
+    }
 
     Log()->trace("<< RtspPlayMedia.constructed");
 }
@@ -138,21 +345,21 @@ onSourcePadData(GstPad* pad,
         ">> RtspPlayMedia.onSourcePadData. pad: {}",
         static_cast<void*>(pad));
 
-    RtspPlayMedia* self = _RTSP_PLAY_MEDIA(userData);
+    Tile* tile = static_cast<Tile*>(userData);
 
     GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
     if(!buffer)
         return GST_PAD_PROBE_OK;
 
 
-    GstClockPtr clockPtr(gst_element_get_clock(self->selector));
+    GstClockPtr clockPtr(gst_element_get_clock(tile->selector));
     GstClock* clock = clockPtr.get();
     if(clock) {
         const GstClockTime bufferTime = gst_clock_get_time(clock);
 
         // Log()->debug("Buffer. Pts: {}, clock: {}", GST_BUFFER_PTS(buffer), bufferTime);
 
-        self->lastBufferTime = bufferTime;
+        tile->lastBufferTime = bufferTime;
     }
 
     Log()->trace("<< RtspPlayMedia.onSourcePadData");
@@ -162,19 +369,19 @@ onSourcePadData(GstPad* pad,
 
 static void
 switchSelector(
-    RtspPlayMedia* self,
+    Tile* tile,
     bool selectSource)
 {
-    GstElement* selector = self->selector;
+    GstElement* selector = tile->selector;
 
-    if(selectSource && !self->sourceSelected) {
+    if(selectSource && !tile->sourceSelected) {
         Log()->debug("RtspPlayMedia. Switching to source.");
-        self->sourceSelected = true;
-        g_object_set(G_OBJECT(selector), "active-pad", self->selectorSourcePad, NULL);
-    } else if(!selectSource && self->sourceSelected) {
+        tile->sourceSelected = true;
+        g_object_set(G_OBJECT(selector), "active-pad", tile->selectorSourcePad, NULL);
+    } else if(!selectSource && tile->sourceSelected) {
         Log()->debug("RtspPlayMedia. Switching to splash screen.");
-        self->sourceSelected = false;
-        g_object_set(G_OBJECT(self->selector), "active-pad", self->selectorTestCardPad, NULL);
+        tile->sourceSelected = false;
+        g_object_set(G_OBJECT(selector), "active-pad", tile->selectorTestCardPad, NULL);
     }
 }
 
@@ -186,17 +393,20 @@ checkSourceTimeout(
 
     RtspPlayMedia* self = _RTSP_PLAY_MEDIA(userData);
 
-    GstClockPtr clockPtr(gst_element_get_clock(self->selector));
-    GstClock* clock = clockPtr.get();
-    if(clock) {
+    for(Tile& tile: self->p->tiles) {
+        GstClockPtr clockPtr(gst_element_get_clock(tile.selector));
+        GstClock* clock = clockPtr.get();
+        if(!clock)
+            continue;
+
         GstClockTime currentTime = gst_clock_get_time(clock);
 
         const bool timeout =
-            GST_CLOCK_DIFF(self->lastBufferTime, currentTime) > (2 * GST_SECOND);
+            GST_CLOCK_DIFF(tile.lastBufferTime, currentTime) > (2 * GST_SECOND);
 
         Log()->debug("Buffer timeout: {}", timeout);
 
-        switchSelector(self, !timeout);
+        switchSelector(&tile, !timeout);
     }
 
     Log()->trace("<< RtspPlayMedia.checkSourceTimeout");
@@ -204,6 +414,67 @@ checkSourceTimeout(
     return GST_PAD_PROBE_OK;
 }
 
+// every remote source with receiver report is a viewer
+static gboolean
+checkViewersHealth(
+    gpointer userData)
+{
+    RtspPlayMedia* self = _RTSP_PLAY_MEDIA(userData);
+    GstRTSPMedia* media = GST_RTSP_MEDIA(userData);
+
+    if(!self->p->channel)
+        return G_SOURCE_CONTINUE;
+
+    unsigned viewers = 0;
+    unsigned congestedViewers = 0;
+
+    const guint streamsCount = gst_rtsp_media_n_streams(media);
+    for(guint i = 0; i < streamsCount; ++i) {
+        GstRTSPStream* stream = gst_rtsp_media_get_stream(media, i);
+        GObject* session = gst_rtsp_stream_get_rtpsession(stream);
+        if(!session)
+            continue;
+
+        GstStructure* stats = nullptr;
+        g_object_get(session, "stats", &stats, NULL);
+        g_object_unref(session);
+        if(!stats)
+            continue;
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        const GValue* sourcesStatsValue =
+            gst_structure_get_value(stats, "source-stats");
+        GValueArray* sourcesStats =
+            sourcesStatsValue ?
+                static_cast<GValueArray*>(g_value_get_boxed(sourcesStatsValue)) :
+                nullptr;
+        for(guint s = 0; sourcesStats && s < sourcesStats->n_values; ++s) {
+            const GstStructure* sourceStats =
+                gst_value_get_structure(g_value_array_get_nth(sourcesStats, s));
+
+            gboolean internal = FALSE;
+            gboolean haveRb = FALSE;
+            guint fractionLost = 0;
+            if(!gst_structure_get_boolean(sourceStats, "internal", &internal) || internal)
+                continue;
+            if(!gst_structure_get_boolean(sourceStats, "have-rb", &haveRb) || !haveRb)
+                continue;
+            gst_structure_get_uint(sourceStats, "rb-fractionlost", &fractionLost);
+
+            ++viewers;
+            if(fractionLost > CongestedFractionLost)
+                ++congestedViewers;
+        }
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+        gst_structure_free(stats);
+    }
+
+    self->p->channel->reportViewersHealth(self, viewers, congestedViewers);
+
+    return G_SOURCE_CONTINUE;
+}
+
 static void
 prepared(
     GstRTSPMedia* media,
@@ -213,17 +484,21 @@ prepared(
 
     RtspPlayMedia* self = _RTSP_PLAY_MEDIA(media);
 
-    self->sourceSelected = false;
-    g_object_set(G_OBJECT(self->selector), "active-pad", self->selectorTestCardPad, NULL);
+    for(Tile& tile: self->p->tiles) {
+        tile.sourceSelected = false;
+        g_object_set(G_OBJECT(tile.selector), "active-pad", tile.selectorTestCardPad, NULL);
 
-    self->sourcePadProbe =
-        gst_pad_add_probe(
-            self->sourcePad,
-            GST_PAD_PROBE_TYPE_BUFFER, onSourcePadData,
-            self, NULL);
+        tile.sourcePadProbe =
+            gst_pad_add_probe(
+                tile.sourcePad,
+                GST_PAD_PROBE_TYPE_BUFFER, onSourcePadData,
+                &tile, NULL);
+    }
 
     self->checkTimeout =
         g_timeout_add(500, checkSourceTimeout, self);
+    self->healthTimeout =
+        g_timeout_add_seconds(1, checkViewersHealth, self);
 
     Log()->trace("<< RtspPlayMedia.prepared");
 }
@@ -237,24 +512,55 @@ unprepared(
 
     RtspPlayMedia* self = _RTSP_PLAY_MEDIA(media);
 
-    gst_pad_remove_probe(self->sourcePad, self->sourcePadProbe);
-    self->sourcePadProbe = 0;
+    for(Tile& tile: self->p->tiles) {
+        gst_pad_remove_probe(tile.sourcePad, tile.sourcePadProbe);
+        tile.sourcePadProbe = 0;
+    }
 
     g_source_remove(self->checkTimeout);
     self->checkTimeout = 0;
 
+    g_source_remove(self->healthTimeout);
+    self->healthTimeout = 0;
+    if(self->p->channel)
+        self->p->channel->removeViewersHealth(self);
+
+    self->p->clearSdpCache();
+
     Log()->trace("<< RtspPlayMedia.unprepared");
 }
 
+static gboolean
+handle_message(
+    GstRTSPMedia* media,
+    GstMessage* message)
+{
+    Private::BusMessageDispatched(media, message);
+
+    return
+        GST_RTSP_MEDIA_CLASS(rtsp_play_media_parent_class)->handle_message(
+            media, message);
+}
+
 static void
 rtsp_play_media_class_init(
     RtspPlayMediaClass* klass)
 {
-    // GstRTSPMediaClass* parent_klass = GST_RTSP_MEDIA_CLASS(klass);
+    GstRTSPMediaClass* parent_klass = GST_RTSP_MEDIA_CLASS(klass);
+
+    parent_klass->handle_message = handle_message;
 
     GObjectClass* objectKlass = G_OBJECT_CLASS(klass);
 
     objectKlass->constructed = constructed;
+    objectKlass->finalize =
+        [] (GObject* object) {
+            RtspPlayMedia* self = _RTSP_PLAY_MEDIA(object);
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_play_media_parent_class)->finalize(object);
+        };
 }
 
 static void
@@ -263,18 +569,10 @@ rtsp_play_media_init(
 {
     // GstRTSPMedia* parent = GST_RTSP_MEDIA(self);
 
-    self->selector = nullptr;
+    self->p = new CxxPrivate;
 
-    self->selectorTestCardPad = nullptr;
-
-    self->sourcePad = nullptr;
-    self->selectorSourcePad = nullptr;
-
-    self->sourcePadProbe = 0;
     self->checkTimeout = 0;
-
-    self->lastBufferTime = 0;
-    self->sourceSelected = false;
+    self->healthTimeout = 0;
 
     g_signal_connect(self, "prepared", G_CALLBACK(prepared), nullptr);
     g_signal_connect(self, "unprepared", G_CALLBACK(unprepared), nullptr);
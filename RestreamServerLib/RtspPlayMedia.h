@@ -1,12 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <gst/rtsp-server/rtsp-server.h>
 
 #include <CxxPtr/GlibPtr.h>
 
 #include "Types.h"
+#include "Channel.h"
 
 
 namespace RestreamServerLib
@@ -17,10 +19,33 @@ G_BEGIN_DECLS
 #define TYPE_RTSP_PLAY_MEDIA rtsp_play_media_get_type()
 G_DECLARE_FINAL_TYPE(RtspPlayMedia, rtsp_play_media, , RTSP_PLAY_MEDIA, GstRTSPMedia)
 
+// one stream per channel, every one with it's own splash screen
 GstElement*
 rtsp_play_media_create_element(
-    const URL& splashSource,
-    const std::string& listenTo);
+    const std::vector<std::shared_ptr<Channel> >&);
+
+// channel media is playing from, used to report viewers health,
+// not set for aggregate media
+void
+rtsp_play_media_set_channel(
+    RtspPlayMedia*,
+    const std::shared_ptr<Channel>&);
+
+// returns copy of SDP cached for specified server address or nullptr,
+// generation of cache is returned to be passed to rtsp_play_media_cache_sdp
+GstSDPMessage*
+rtsp_play_media_get_cached_sdp(
+    RtspPlayMedia*,
+    const std::string& serverIp,
+    unsigned* generation);
+
+// SDP is not cached if cache was dropped after generation was taken
+void
+rtsp_play_media_cache_sdp(
+    RtspPlayMedia*,
+    const std::string& serverIp,
+    unsigned generation,
+    const GstSDPMessage*);
 
 G_END_DECLS
 
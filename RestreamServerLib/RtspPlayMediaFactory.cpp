@@ -1,6 +1,13 @@
 #include "RtspPlayMediaFactory.h"
 
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
 #include "Log.h"
+#include "Private.h"
 #include "RtspRecordMediaFactory.h"
 
 
@@ -10,10 +17,19 @@ namespace RestreamServerLib
 namespace
 {
 
+const guint UlpfecPayloadType = 122;
+
 struct CxxPrivate
 {
-    URL splashSource;
-    std::string listenTo;
+    // one per stream of media
+    std::vector<std::shared_ptr<Channel> > channels;
+
+    std::atomic<unsigned> viewersPerShard { 0 };
+    std::atomic<unsigned> fecPercentage { 0 };
+
+    std::mutex shardsMutex;
+    std::map<GstRTSPClient*, unsigned> clientsShards;
+    std::vector<unsigned> shardsViewers;
 };
 
 }
@@ -29,6 +45,14 @@ static GstElement*
 create_element(
     GstRTSPMediaFactory* factory,
     const GstRTSPUrl* url);
+static gchar*
+gen_key(
+    GstRTSPMediaFactory* factory,
+    const GstRTSPUrl* url);
+static void
+media_constructed(
+    GstRTSPMediaFactory* factory,
+    GstRTSPMedia* media);
 
 
 G_DEFINE_TYPE(
@@ -39,21 +63,55 @@ G_DEFINE_TYPE(
 
 RtspPlayMediaFactory*
 rtsp_play_media_factory_new(
-    const URL& splashSource,
-    const std::string& listenTo)
+    const std::shared_ptr<Channel>& channel)
+{
+    RtspPlayMediaFactory* instance =
+        _RTSP_PLAY_MEDIA_FACTORY(
+            g_object_new(TYPE_RTSP_PLAY_MEDIA_FACTORY, NULL));
+
+    if(instance) {
+        instance->p->channels.push_back(channel);
+    }
+
+    return instance;
+}
+
+RtspPlayMediaFactory*
+rtsp_play_media_factory_new_aggregate(
+    const std::vector<std::shared_ptr<Channel> >& channels)
 {
     RtspPlayMediaFactory* instance =
         _RTSP_PLAY_MEDIA_FACTORY(
             g_object_new(TYPE_RTSP_PLAY_MEDIA_FACTORY, NULL));
 
     if(instance) {
-        instance->p->splashSource = splashSource;
-        instance->p->listenTo = listenTo;
+        instance->p->channels = channels;
     }
 
     return instance;
 }
 
+void
+rtsp_play_media_factory_set_viewers_per_shard(
+    RtspPlayMediaFactory* self,
+    unsigned viewersPerShard)
+{
+    self->p->viewersPerShard = viewersPerShard;
+}
+
+void
+rtsp_play_media_factory_set_fec_overhead(
+    RtspPlayMediaFactory* self,
+    unsigned percentage)
+{
+#if GST_CHECK_VERSION(1, 16, 0)
+    self->p->fecPercentage = percentage;
+#else
+    if(percentage)
+        Log()->warn("FEC requires GStreamer 1.16 or newer");
+#endif
+}
+
 static void
 rtsp_play_media_factory_class_init(
     RtspPlayMediaFactoryClass* klass)
@@ -62,6 +120,18 @@ rtsp_play_media_factory_class_init(
         GST_RTSP_MEDIA_FACTORY_CLASS(klass);
 
     parent_klass->create_element = create_element;
+    parent_klass->gen_key = gen_key;
+    parent_klass->media_constructed = media_constructed;
+
+    GObjectClass* objectKlass = G_OBJECT_CLASS(klass);
+    objectKlass->finalize =
+        [] (GObject* object) {
+            RtspPlayMediaFactory* self = _RTSP_PLAY_MEDIA_FACTORY(object);
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_play_media_factory_parent_class)->finalize(object);
+        };
 }
 
 static void
@@ -75,6 +145,7 @@ rtsp_play_media_factory_init(
     gst_rtsp_media_factory_set_transport_mode(
         parent, GST_RTSP_TRANSPORT_MODE_PLAY);
     gst_rtsp_media_factory_set_shared(parent, TRUE);
+    gst_rtsp_media_factory_set_clock(parent, Private::SharedClock());
 
     gst_rtsp_media_factory_set_media_gtype(parent, TYPE_RTSP_PLAY_MEDIA);
 }
@@ -87,9 +158,124 @@ create_element(
     RtspPlayMediaFactory* self = _RTSP_PLAY_MEDIA_FACTORY(factory);
 
     return
-        rtsp_play_media_create_element(
-            self->p->splashSource,
-            self->p->listenTo);
+        rtsp_play_media_create_element(self->p->channels);
+}
+
+static void
+client_closed(
+    GstRTSPClient* client,
+    gpointer userData)
+{
+    RtspPlayMediaFactory* self = _RTSP_PLAY_MEDIA_FACTORY(userData);
+    CxxPrivate& p = *self->p;
+
+    std::lock_guard<std::mutex> lock(p.shardsMutex);
+
+    auto it = p.clientsShards.find(client);
+    if(it == p.clientsShards.end())
+        return;
+
+    --p.shardsViewers[it->second];
+    p.clientsShards.erase(it);
+}
+
+// client stays in the same shard for it's whole life,
+// otherwise DESCRIBE and SETUP could end up in different medias
+static unsigned
+client_shard(
+    RtspPlayMediaFactory* self,
+    GstRTSPClient* client,
+    unsigned viewersPerShard)
+{
+    CxxPrivate& p = *self->p;
+
+    std::lock_guard<std::mutex> lock(p.shardsMutex);
+
+    auto it = p.clientsShards.find(client);
+    if(it != p.clientsShards.end())
+        return it->second;
+
+    const unsigned shardsCount =
+        1 + p.clientsShards.size() / viewersPerShard;
+    if(p.shardsViewers.size() < shardsCount) {
+        Log()->info(
+            "Starting new egress shard. shard: {}, viewers: {}",
+            shardsCount - 1, p.clientsShards.size());
+        p.shardsViewers.resize(shardsCount, 0);
+    }
+
+    const unsigned shard =
+        std::min_element(
+            p.shardsViewers.begin(),
+            p.shardsViewers.begin() + shardsCount) - p.shardsViewers.begin();
+
+    ++p.shardsViewers[shard];
+    p.clientsShards.emplace(client, shard);
+
+    g_signal_connect_object(
+        client, "closed",
+        G_CALLBACK(client_closed), self, GConnectFlags(0));
+
+    return shard;
+}
+
+static gchar*
+gen_key(
+    GstRTSPMediaFactory* factory,
+    const GstRTSPUrl* url)
+{
+    RtspPlayMediaFactory* self = _RTSP_PLAY_MEDIA_FACTORY(factory);
+
+    gchar* key =
+        GST_RTSP_MEDIA_FACTORY_CLASS(rtsp_play_media_factory_parent_class)->
+            gen_key(factory, url);
+
+    // could be changed concurrently, so it's read once
+    const unsigned viewersPerShard = self->p->viewersPerShard;
+    if(!key || 0 == viewersPerShard)
+        return key;
+
+    GstRTSPContext* context = gst_rtsp_context_get_current();
+    if(!context || !context->client)
+        return key;
+
+    const unsigned shard = client_shard(self, context->client, viewersPerShard);
+    if(0 == shard)
+        return key;
+
+    // shards share samples from channel but have own pipelines
+    // and so own streaming threads
+    gchar* shardKey = g_strdup_printf("%s#shard%u", key, shard);
+    g_free(key);
+
+    return shardKey;
+}
+
+static void
+media_constructed(
+    GstRTSPMediaFactory* factory,
+    GstRTSPMedia* media)
+{
+    RtspPlayMediaFactory* self = _RTSP_PLAY_MEDIA_FACTORY(factory);
+
+    if(1 == self->p->channels.size())
+        rtsp_play_media_set_channel(_RTSP_PLAY_MEDIA(media), self->p->channels.front());
+    Private::UseSharedBaseTime(media);
+    Private::FilterBusMessages(media);
+
+#if GST_CHECK_VERSION(1, 16, 0)
+    // FEC is generated once per media and shared by all it's players
+    const unsigned fecPercentage = self->p->fecPercentage;
+    if(0 == fecPercentage)
+        return;
+
+    const guint streamsCount = gst_rtsp_media_n_streams(media);
+    for(guint i = 0; i < streamsCount; ++i) {
+        GstRTSPStream* stream = gst_rtsp_media_get_stream(media, i);
+        gst_rtsp_stream_set_ulpfec_pt(stream, UlpfecPayloadType);
+        gst_rtsp_stream_set_ulpfec_percentage(stream, fecPercentage);
+    }
+#endif
 }
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <gst/rtsp-server/rtsp-server.h>
 
@@ -22,8 +23,28 @@ G_DECLARE_FINAL_TYPE(
 
 RtspPlayMediaFactory*
 rtsp_play_media_factory_new(
-    const URL& splashSource,
-    const std::string& listenTo);
+    const std::shared_ptr<Channel>&);
+
+// media with one stream per channel, delivered in one session
+RtspPlayMediaFactory*
+rtsp_play_media_factory_new_aggregate(
+    const std::vector<std::shared_ptr<Channel> >&);
+
+// splits players across several medias (shards) every one of which
+// streams from it's own thread, new shard is started
+// each time players count exceeds multiple of viewersPerShard,
+// 0 disables sharding
+void
+rtsp_play_media_factory_set_viewers_per_shard(
+    RtspPlayMediaFactory*,
+    unsigned viewersPerShard);
+
+// enables ULPFEC with specified overhead percentage
+// for medias created after call, 0 disables FEC
+void
+rtsp_play_media_factory_set_fec_overhead(
+    RtspPlayMediaFactory*,
+    unsigned percentage);
 
 G_END_DECLS
 
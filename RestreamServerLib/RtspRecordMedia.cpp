@@ -2,17 +2,32 @@
 
 #include <glib.h>
 
+#include <gst/rtp/gstrtcpbuffer.h>
+
 #include <CxxPtr/GstPtr.h>
 
 #include "Log.h"
+#include "Private.h"
 
 
 namespace RestreamServerLib
 {
 
+namespace
+{
+
+struct CxxPrivate
+{
+    std::shared_ptr<Channel> channel;
+};
+
+}
+
 struct _RtspRecordMedia
 {
     GstRTSPMedia parent_instance;
+
+    CxxPrivate* p;
 };
 
 
@@ -24,15 +39,16 @@ G_DEFINE_TYPE(
 
 GstElement*
 rtsp_record_media_create_element(
-    const std::string& proxyName)
+    const std::shared_ptr<Channel>& channel)
 {
     Log()->trace(">> rtsp_record_media_create_element");
 
+    // every sample pushed to channel starts from access unit
+    // and keyframes carry SPS/PPS, so listeners can join at any keyframe
     const std::string pipeline =
-        fmt::format(
-            "rtph264depay name=depay0 ! h264parse ! "
-            "interpipesink name={} sync=true allow-negotiation=false",
-            proxyName);
+        "rtph264depay name=depay0 ! h264parse config-interval=-1 ! "
+        "video/x-h264,stream-format=byte-stream,alignment=au ! "
+        "appsink name=channel";
 
     GError* error = nullptr;
     GstElement* element =
@@ -46,9 +62,114 @@ rtsp_record_media_create_element(
             "Fail to create record pipeline: {}",
             errorPtr->message);
 
+    if(element) {
+        GstElementPtr appsinkPtr(gst_bin_get_by_name(GST_BIN(element), "channel"));
+        if(appsinkPtr)
+            Channel::attachAppSink(channel, appsinkPtr.get());
+    }
+
     return element;
 }
 
+void
+rtsp_record_media_set_channel(
+    RtspRecordMedia* self,
+    const std::shared_ptr<Channel>& channel)
+{
+    self->p->channel = channel;
+}
+
+// draft-alvestrand-rmcat-remb
+static void
+addRemb(
+    GstBuffer* buffer,
+    guint bitrate,
+    guint32 mediaSsrc)
+{
+    GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+    if(!gst_rtcp_buffer_map(buffer, GST_MAP_READWRITE, &rtcp))
+        return;
+
+    GstRTCPPacket packet;
+    guint32 senderSsrc = 0;
+    if(gst_rtcp_buffer_get_first_packet(&rtcp, &packet)) {
+        switch(gst_rtcp_packet_get_type(&packet)) {
+        case GST_RTCP_TYPE_SR:
+            gst_rtcp_packet_sr_get_sender_info(
+                &packet, &senderSsrc, nullptr, nullptr, nullptr, nullptr);
+            break;
+        case GST_RTCP_TYPE_RR:
+            senderSsrc = gst_rtcp_packet_rr_get_ssrc(&packet);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if(gst_rtcp_buffer_add_packet(&rtcp, GST_RTCP_TYPE_PSFB, &packet)) {
+        gst_rtcp_packet_fb_set_type(&packet, GST_RTCP_PSFB_TYPE_AFB);
+        gst_rtcp_packet_fb_set_sender_ssrc(&packet, senderSsrc);
+        gst_rtcp_packet_fb_set_media_ssrc(&packet, 0);
+
+        if(gst_rtcp_packet_fb_set_fci_length(&packet, 3)) {
+            guint exponent = 0;
+            guint mantissa = bitrate;
+            while(mantissa > 0x3ffff) {
+                mantissa >>= 1;
+                ++exponent;
+            }
+
+            guint8* fci = gst_rtcp_packet_fb_get_fci(&packet);
+            fci[0] = 'R';
+            fci[1] = 'E';
+            fci[2] = 'M';
+            fci[3] = 'B';
+            fci[4] = 1; // SSRCs count
+            fci[5] = (exponent << 2) | ((mantissa >> 16) & 0x03);
+            fci[6] = (mantissa >> 8) & 0xff;
+            fci[7] = mantissa & 0xff;
+            GST_WRITE_UINT32_BE(fci + 8, mediaSsrc);
+        } else
+            gst_rtcp_packet_remove(&packet);
+    }
+
+    gst_rtcp_buffer_unmap(&rtcp);
+}
+
+static gboolean
+onSendingRtcp(
+    GObject* /*session*/,
+    GstBuffer* buffer,
+    gboolean /*early*/,
+    gpointer userData)
+{
+    RtspRecordMedia* self = _RTSP_RECORD_MEDIA(userData);
+
+    const std::shared_ptr<Channel>& channel = self->p->channel;
+    const guint bitrate = channel ? channel->recommendedBitrate() : 0;
+    if(0 == bitrate)
+        return FALSE;
+
+    GstElementPtr pipelinePtr(gst_rtsp_media_get_element(GST_RTSP_MEDIA(self)));
+    GstElementPtr depayPtr(gst_bin_get_by_name(GST_BIN(pipelinePtr.get()), "depay0"));
+    if(!depayPtr)
+        return FALSE;
+
+    // recorder's SSRC is known from depayloader input
+    GstPadPtr sinkPadPtr(gst_element_get_static_pad(depayPtr.get(), "sink"));
+    GstCapsPtr capsPtr(gst_pad_get_current_caps(sinkPadPtr.get()));
+    guint mediaSsrc = 0;
+    if(!capsPtr ||
+       !gst_structure_get_uint(gst_caps_get_structure(capsPtr.get(), 0), "ssrc", &mediaSsrc))
+    {
+        return FALSE;
+    }
+
+    addRemb(buffer, bitrate, mediaSsrc);
+
+    return FALSE;
+}
+
 static void
 constructed(
     GObject* object)
@@ -66,7 +187,10 @@ finalize(
 {
     Log()->trace(">> RtspRecordMedia.finalize");
 
-    // RtspRecordMedia* self = _RTSP_RECORD_MEDIA(object);
+    RtspRecordMedia* self = _RTSP_RECORD_MEDIA(object);
+
+    delete self->p;
+    self->p = nullptr;
 
     G_OBJECT_CLASS(rtsp_record_media_parent_class)->finalize(object);
 }
@@ -77,6 +201,21 @@ prepared(
     gpointer userData)
 {
     Log()->trace(">> RtspRecordMedia.prepared");
+
+    RtspRecordMedia* self = _RTSP_RECORD_MEDIA(media);
+
+    const guint streamsCount = gst_rtsp_media_n_streams(media);
+    for(guint i = 0; i < streamsCount; ++i) {
+        GstRTSPStream* stream = gst_rtsp_media_get_stream(media, i);
+        GObject* session = gst_rtsp_stream_get_rtpsession(stream);
+        if(!session)
+            continue;
+
+        g_signal_connect_object(
+            session, "on-sending-rtcp",
+            G_CALLBACK(onSendingRtcp), self, GConnectFlags(0));
+        g_object_unref(session);
+    }
 }
 
 static void
@@ -89,13 +228,27 @@ unprepared(
     // RtspRecordMedia* self = _RTSP_RECORD_MEDIA(media);
 }
 
+static gboolean
+handle_message(
+    GstRTSPMedia* media,
+    GstMessage* message)
+{
+    Private::BusMessageDispatched(media, message);
+
+    return
+        GST_RTSP_MEDIA_CLASS(rtsp_record_media_parent_class)->handle_message(
+            media, message);
+}
+
 static void
 rtsp_record_media_class_init(
     RtspRecordMediaClass* klass)
 {
     Log()->trace(">> RtspRecordMedia.class_init");
 
-    // GstRTSPMediaClass* parent_klass = GST_RTSP_MEDIA_CLASS(klass);
+    GstRTSPMediaClass* parent_klass = GST_RTSP_MEDIA_CLASS(klass);
+
+    parent_klass->handle_message = handle_message;
 
     GObjectClass* objectKlass = G_OBJECT_CLASS(klass);
 
@@ -113,6 +266,8 @@ rtsp_record_media_init(
 
     // GstRTSPMedia* parent = GST_RTSP_MEDIA(self);
 
+    self->p = new CxxPrivate;
+
     g_signal_connect(self, "prepared", G_CALLBACK(prepared), nullptr);
     g_signal_connect(self, "unprepared", G_CALLBACK(unprepared), nullptr);
 }
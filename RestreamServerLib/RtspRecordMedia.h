@@ -6,6 +6,8 @@
 
 #include <CxxPtr/GlibPtr.h>
 
+#include "Channel.h"
+
 
 namespace RestreamServerLib
 {
@@ -22,7 +24,14 @@ G_DECLARE_FINAL_TYPE(
 
 GstElement*
 rtsp_record_media_create_element(
-    const std::string& proxyName);
+    const std::shared_ptr<Channel>&);
+
+// channel media is recording to,
+// used to send bitrate recommendation to recorder
+void
+rtsp_record_media_set_channel(
+    RtspRecordMedia*,
+    const std::shared_ptr<Channel>&);
 
 G_END_DECLS
 
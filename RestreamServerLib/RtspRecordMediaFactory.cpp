@@ -1,6 +1,9 @@
 #include "RtspRecordMediaFactory.h"
 
+#include <CxxPtr/GstPtr.h>
+
 #include "Log.h"
+#include "Private.h"
 #include "RtspPlayMediaFactory.h"
 
 
@@ -10,9 +13,11 @@ namespace RestreamServerLib
 namespace
 {
 
+const guint DefaultIngestLatency = 200; // ms
+
 struct CxxPrivate
 {
-    std::string proxyName;
+    std::shared_ptr<Channel> channel;
 };
 
 }
@@ -28,6 +33,10 @@ static GstElement*
 create_element(
     GstRTSPMediaFactory* factory,
     const GstRTSPUrl* url);
+static void
+media_constructed(
+    GstRTSPMediaFactory* factory,
+    GstRTSPMedia* media);
 
 
 G_DEFINE_TYPE(
@@ -38,14 +47,14 @@ G_DEFINE_TYPE(
 
 RtspRecordMediaFactory*
 rtsp_record_media_factory_new(
-    const std::string& proxyName)
+    const std::shared_ptr<Channel>& channel)
 {
     RtspRecordMediaFactory* instance =
         _RTSP_RECORD_MEDIA_FACTORY(
             g_object_new(TYPE_RTSP_RECORD_MEDIA_FACTORY, NULL));
 
     if(instance)
-        instance->p->proxyName = proxyName;
+        instance->p->channel = channel;
 
     return instance;
 }
@@ -58,6 +67,17 @@ rtsp_record_media_factory_class_init(
         GST_RTSP_MEDIA_FACTORY_CLASS(klass);
 
     parent_klass->create_element = create_element;
+    parent_klass->media_constructed = media_constructed;
+
+    GObjectClass* objectKlass = G_OBJECT_CLASS(klass);
+    objectKlass->finalize =
+        [] (GObject* object) {
+            RtspRecordMediaFactory* self = _RTSP_RECORD_MEDIA_FACTORY(object);
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_record_media_factory_parent_class)->finalize(object);
+        };
 }
 
 static void
@@ -71,6 +91,17 @@ rtsp_record_media_factory_init(
     gst_rtsp_media_factory_set_transport_mode(
         parent, GST_RTSP_TRANSPORT_MODE_RECORD);
     gst_rtsp_media_factory_set_shared(parent, TRUE);
+    gst_rtsp_media_factory_set_clock(parent, Private::SharedClock());
+
+    // lost packet damages stream for every player of path,
+    // so it's worth to ask recorder to send it again
+#if GST_CHECK_VERSION(1, 16, 0)
+    gst_rtsp_media_factory_set_do_retransmission(parent, TRUE);
+#endif
+    gst_rtsp_media_factory_set_profiles(
+        parent,
+        GstRTSPProfile(GST_RTSP_PROFILE_AVP | GST_RTSP_PROFILE_AVPF));
+    gst_rtsp_media_factory_set_latency(parent, DefaultIngestLatency);
 
     gst_rtsp_media_factory_set_media_gtype(parent, TYPE_RTSP_RECORD_MEDIA);
 }
@@ -84,7 +115,50 @@ create_element(
 
     return
         rtsp_record_media_create_element(
-            self->p->proxyName);
+            self->p->channel);
+}
+
+// rtpsession translates upstream GstForceKeyUnit event to PLI/FIR
+static void
+media_constructed(
+    GstRTSPMediaFactory* factory,
+    GstRTSPMedia* media)
+{
+    RtspRecordMediaFactory* self = _RTSP_RECORD_MEDIA_FACTORY(factory);
+
+    rtsp_record_media_set_channel(_RTSP_RECORD_MEDIA(media), self->p->channel);
+    Private::UseSharedBaseTime(media);
+    Private::FilterBusMessages(media);
+
+    // lets channel ask recorder for keyframe
+    GstElementPtr elementPtr(gst_rtsp_media_get_element(media));
+    GstElementPtr depayPtr(gst_bin_get_by_name(GST_BIN(elementPtr.get()), "depay0"));
+    if(!depayPtr)
+        return;
+
+    std::shared_ptr<GWeakRef> depayRef(
+        new GWeakRef,
+        [] (GWeakRef* weakRef) {
+            g_weak_ref_clear(weakRef);
+            delete weakRef;
+        });
+    g_weak_ref_init(depayRef.get(), depayPtr.get());
+
+    self->p->channel->setKeyframeRequestHandler(
+        [depayRef] () {
+            GstElementPtr depayPtr(GST_ELEMENT(g_weak_ref_get(depayRef.get())));
+            if(!depayPtr)
+                return;
+
+            gst_element_send_event(
+                depayPtr.get(),
+                gst_event_new_custom(
+                    GST_EVENT_CUSTOM_UPSTREAM,
+                    gst_structure_new(
+                        "GstForceKeyUnit",
+                        "all-headers", G_TYPE_BOOLEAN, TRUE,
+                        NULL)));
+        });
 }
 
 }
@@ -22,7 +22,7 @@ G_DECLARE_FINAL_TYPE(
 
 RtspRecordMediaFactory*
 rtsp_record_media_factory_new(
-    const std::string& proxyName);
+    const std::shared_ptr<Channel>&);
 
 G_END_DECLS
 
@@ -0,0 +1,132 @@
+#include "RtspServer.h"
+
+#include "Log.h"
+#include "RtspClient.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+struct CxxPrivate
+{
+    std::shared_ptr<SessionResume> sessionResume;
+    std::shared_ptr<PathDirectory> pathDirectory;
+};
+
+}
+
+struct _RtspServer
+{
+    GstRTSPServer parent_instance;
+
+    CxxPrivate* p;
+};
+
+
+G_DEFINE_TYPE(
+    RtspServer,
+    rtsp_server,
+    GST_TYPE_RTSP_SERVER)
+
+
+static GstRTSPClient*
+create_client(GstRTSPServer* server);
+
+
+RtspServer*
+rtsp_server_new()
+{
+    return _RTSP_SERVER(g_object_new(TYPE_RTSP_SERVER, NULL));
+}
+
+void
+rtsp_server_set_session_resume(
+    RtspServer* self,
+    const std::shared_ptr<SessionResume>& sessionResume)
+{
+    self->p->sessionResume = sessionResume;
+}
+
+void
+rtsp_server_set_path_directory(
+    RtspServer* self,
+    const std::shared_ptr<PathDirectory>& pathDirectory)
+{
+    self->p->pathDirectory = pathDirectory;
+}
+
+static void
+rtsp_server_class_init(RtspServerClass* klass)
+{
+    GstRTSPServerClass* gst_server_klass =
+        GST_RTSP_SERVER_CLASS(klass);
+
+    gst_server_klass->create_client = create_client;
+
+    GObjectClass* object_klass = G_OBJECT_CLASS(klass);
+    object_klass->finalize =
+        [] (GObject* object) {
+            RtspServer* self = _RTSP_SERVER(object);
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_server_parent_class)->finalize(object);
+        };
+}
+
+static void
+rtsp_server_init(RtspServer* self)
+{
+    self->p = new CxxPrivate;
+}
+
+// the same as default GstRTSPServer::create_client,
+// but creates RtspClient instead of GstRTSPClient
+static GstRTSPClient*
+create_client(GstRTSPServer* server)
+{
+    RtspServer* self = _RTSP_SERVER(server);
+
+    RtspClient* rtspClient = rtsp_client_new();
+    rtsp_client_set_session_resume(rtspClient, self->p->sessionResume);
+    rtsp_client_set_path_directory(rtspClient, self->p->pathDirectory);
+
+    GstRTSPClient* client = GST_RTSP_CLIENT(rtspClient);
+
+    GstRTSPSessionPool* sessionPool = gst_rtsp_server_get_session_pool(server);
+    if(sessionPool) {
+        gst_rtsp_client_set_session_pool(client, sessionPool);
+        g_object_unref(sessionPool);
+    }
+
+    GstRTSPMountPoints* mountPoints = gst_rtsp_server_get_mount_points(server);
+    if(mountPoints) {
+        gst_rtsp_client_set_mount_points(client, mountPoints);
+        g_object_unref(mountPoints);
+    }
+
+    GstRTSPAuth* auth = gst_rtsp_server_get_auth(server);
+    if(auth) {
+        gst_rtsp_client_set_auth(client, auth);
+        g_object_unref(auth);
+    }
+
+    GstRTSPThreadPool* threadPool = gst_rtsp_server_get_thread_pool(server);
+    if(threadPool) {
+        gst_rtsp_client_set_thread_pool(client, threadPool);
+        g_object_unref(threadPool);
+    }
+
+#if GST_CHECK_VERSION(1, 18, 0)
+    gst_rtsp_client_set_content_length_limit(
+        client,
+        gst_rtsp_server_get_content_length_limit(server));
+#endif
+
+    return client;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "SessionResume.h"
+#include "PathDirectory.h"
+
+
+namespace RestreamServerLib
+{
+
+G_BEGIN_DECLS
+
+#define TYPE_RTSP_SERVER rtsp_server_get_type()
+G_DECLARE_FINAL_TYPE(
+    RtspServer,
+    rtsp_server,
+    ,
+    RTSP_SERVER,
+    GstRTSPServer)
+
+RtspServer*
+rtsp_server_new();
+
+// nullptr disables session resume
+void
+rtsp_server_set_session_resume(
+    RtspServer*,
+    const std::shared_ptr<SessionResume>&);
+
+// nullptr disables redirects to nodes owning paths
+void
+rtsp_server_set_path_directory(
+    RtspServer*,
+    const std::shared_ptr<PathDirectory>&);
+
+G_END_DECLS
+
+}
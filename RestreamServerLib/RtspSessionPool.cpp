@@ -0,0 +1,186 @@
+#include "RtspSessionPool.h"
+
+#include <mutex>
+#include <unordered_set>
+
+#include "Log.h"
+#include "TimerWheel.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+// in ms
+const uint64_t WheelTick = 250;
+
+uint64_t Now()
+{
+    return g_get_monotonic_time() / 1000;
+}
+
+struct CxxPrivate
+{
+    CxxPrivate() :
+        wheel(WheelTick, Now()) {}
+
+    std::mutex mutex;
+    TimerWheel wheel;
+    std::unordered_set<const GstRTSPSession*> sessions;
+
+    guint tickSource = 0;
+};
+
+}
+
+struct _RtspSessionPool
+{
+    GstRTSPSessionPool parent_instance;
+
+    CxxPrivate* p;
+};
+
+
+G_DEFINE_TYPE(
+    RtspSessionPool,
+    rtsp_session_pool,
+    GST_TYPE_RTSP_SESSION_POOL)
+
+
+static GstRTSPSession*
+create_session(GstRTSPSessionPool* pool, const gchar* id);
+static void
+session_removed(GstRTSPSessionPool* pool, GstRTSPSession* session);
+static gboolean
+on_tick(gpointer userData);
+
+
+RtspSessionPool*
+rtsp_session_pool_new()
+{
+    return _RTSP_SESSION_POOL(g_object_new(TYPE_RTSP_SESSION_POOL, NULL));
+}
+
+static void
+rtsp_session_pool_class_init(RtspSessionPoolClass* klass)
+{
+    GstRTSPSessionPoolClass* gst_session_pool_klass =
+        GST_RTSP_SESSION_POOL_CLASS(klass);
+
+    gst_session_pool_klass->create_session = create_session;
+    gst_session_pool_klass->session_removed = session_removed;
+
+    GObjectClass* object_klass = G_OBJECT_CLASS(klass);
+    object_klass->finalize =
+        [] (GObject* object) {
+            RtspSessionPool* self = _RTSP_SESSION_POOL(object);
+
+            if(self->p->tickSource)
+                g_source_remove(self->p->tickSource);
+
+            delete self->p;
+            self->p = nullptr;
+
+            G_OBJECT_CLASS(rtsp_session_pool_parent_class)->finalize(object);
+        };
+}
+
+static void
+rtsp_session_pool_init(RtspSessionPool* self)
+{
+    self->p = new CxxPrivate;
+
+    self->p->tickSource = g_timeout_add(WheelTick, on_tick, self);
+}
+
+static GstRTSPSession*
+create_session(GstRTSPSessionPool* pool, const gchar* id)
+{
+    RtspSessionPool* self = _RTSP_SESSION_POOL(pool);
+
+    GstRTSPSession* session =
+        GST_RTSP_SESSION_POOL_CLASS(rtsp_session_pool_parent_class)->
+            create_session(pool, id);
+    if(!session)
+        return nullptr;
+
+    const uint64_t timeout = gst_rtsp_session_get_timeout(session) * 1000;
+
+    std::lock_guard<std::mutex> lock(self->p->mutex);
+
+    self->p->sessions.insert(session);
+    self->p->wheel.schedule(session, Now() + timeout);
+
+    return session;
+}
+
+static void
+session_removed(GstRTSPSessionPool* pool, GstRTSPSession* session)
+{
+    RtspSessionPool* self = _RTSP_SESSION_POOL(pool);
+
+    std::lock_guard<std::mutex> lock(self->p->mutex);
+
+    self->p->sessions.erase(session);
+    self->p->wheel.cancel(session);
+}
+
+// Sessions are touched by gst-rtsp-server on every request and RTCP packet,
+// so instead of rescheduling timer on every touch
+// the actual timeout is checked only when scheduled deadline is reached
+static gboolean
+on_tick(gpointer userData)
+{
+    RtspSessionPool* self = _RTSP_SESSION_POOL(userData);
+    GstRTSPSessionPool* pool = GST_RTSP_SESSION_POOL(self);
+
+    std::vector<TimerWheel::Key> due;
+    {
+        std::lock_guard<std::mutex> lock(self->p->mutex);
+
+        self->p->wheel.advance(Now(), &due);
+
+        // session can't be finalized while it's in wheel
+        for(TimerWheel::Key key: due)
+            g_object_ref(const_cast<void*>(key));
+    }
+
+    if(due.empty())
+        return G_SOURCE_CONTINUE;
+
+    const gint64 nowUsec = g_get_monotonic_time();
+
+    unsigned expiredCount = 0;
+    for(TimerWheel::Key key: due) {
+        GstRTSPSession* session =
+            GST_RTSP_SESSION(const_cast<void*>(key));
+
+        if(gst_rtsp_session_is_expired_usec(session, nowUsec)) {
+            ++expiredCount;
+            gst_rtsp_session_pool_remove(pool, session);
+        } else {
+            const gint timeout =
+                gst_rtsp_session_next_timeout_usec(session, nowUsec);
+
+            std::lock_guard<std::mutex> lock(self->p->mutex);
+
+            if(self->p->sessions.count(session)) {
+                self->p->wheel.schedule(
+                    session,
+                    Now() + (timeout > 0 ? timeout : WheelTick));
+            }
+        }
+
+        g_object_unref(session);
+    }
+
+    Log()->debug(
+        "RtspSessionPool. Sessions checked: {}, expired: {}",
+        due.size(), expiredCount);
+
+    return G_SOURCE_CONTINUE;
+}
+
+}
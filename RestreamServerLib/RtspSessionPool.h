@@ -0,0 +1,26 @@
+#pragma once
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+
+namespace RestreamServerLib
+{
+
+G_BEGIN_DECLS
+
+#define TYPE_RTSP_SESSION_POOL rtsp_session_pool_get_type()
+G_DECLARE_FINAL_TYPE(
+    RtspSessionPool,
+    rtsp_session_pool,
+    ,
+    RTSP_SESSION_POOL,
+    GstRTSPSessionPool)
+
+// session pool tracking sessions deadlines with timer wheel,
+// so expiration doesn't require periodic scan of all sessions
+RtspSessionPool*
+rtsp_session_pool_new();
+
+G_END_DECLS
+
+}
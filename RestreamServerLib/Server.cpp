@@ -2,6 +2,9 @@
 
 #include <set>
 #include <map>
+#include <deque>
+#include <mutex>
+#include <vector>
 
 #include <CxxPtr/GstRtspServerPtr.h>
 
@@ -10,6 +13,15 @@
 #include "Types.h"
 #include "RtspAuth.h"
 #include "RtspMountPoints.h"
+#include "RtspServer.h"
+#include "RtspSessionPool.h"
+#include "ShmEgress.h"
+#include "DecodedTap.h"
+#include "SrtIngest.h"
+#include "WhipIngest.h"
+#include "PathDirectory.h"
+#include "IngestMirror.h"
+#include "Private.h"
 
 #if GST_CHECK_VERSION(1, 12, 0)
 #define ENABLE_LIMITS 1
@@ -35,6 +47,76 @@ struct PathInfo
     std::string recordSessionId;
 };
 
+struct UserInfo
+{
+    unsigned sessions = 0;
+    unsigned publishedPaths = 0;
+    std::map<std::shared_ptr<Channel>, unsigned> playedChannels;
+};
+
+typedef std::vector<std::shared_ptr<Channel> > Channels;
+
+struct SessionInfo
+{
+    std::string user;
+    bool record;
+    // every tile of aggregate url
+    Channels channels;
+};
+
+const std::string DecodedSuffix = "?decoded";
+
+const std::string IngestSessionPrefix = "ingest:";
+
+// client and session id
+typedef std::pair<const GstRTSPClient*, std::string> SessionKey;
+
+// sub stream recorder is registered as separate path
+std::string SubPath(const std::string& path)
+{
+    return path + "?" + RestreamServerLib::Private::SubSuffix;
+}
+
+bool IsSubPath(const std::string& path)
+{
+    return path.find('?') != std::string::npos;
+}
+
+// strips "?decoded" suffix of path requested through ShmEgress
+std::string ShmPathToPath(const std::string& shmPath, bool* decoded)
+{
+    const std::string::size_type suffixPos = shmPath.rfind(DecodedSuffix);
+    *decoded =
+        suffixPos != std::string::npos &&
+        suffixPos + DecodedSuffix.size() == shmPath.size();
+
+    return *decoded ? shmPath.substr(0, suffixPos) : shmPath;
+}
+
+// every tile of aggregate url is played as separate path
+std::vector<std::string> UrlPaths(GstRTSPMethod method, const GstRTSPUrl* url)
+{
+    std::vector<std::string> paths;
+    if(RestreamServerLib::Private::ParseTilesUrl(url, &paths))
+        return paths;
+
+    if(RestreamServerLib::Private::IsSubRecordUrl(method, url))
+        paths.push_back(SubPath(url->abspath));
+    else
+        paths.push_back(url->abspath);
+
+    return paths;
+}
+
+unsigned EgressBitrate(const UserInfo& userInfo)
+{
+    unsigned bitrate = 0;
+    for(const auto& pair: userInfo.playedChannels)
+        bitrate += pair.first->ingestBitrate() * pair.second;
+
+    return bitrate;
+}
+
 }
 
 struct Server::Private
@@ -45,6 +127,7 @@ struct Server::Private
         unsigned short restreamPort,
         unsigned maxPathsCount,
         unsigned maxClientsPerPath);
+    ~Private();
 
     Callbacks callbacks;
 
@@ -60,9 +143,41 @@ struct Server::Private
     GstRTSPTokenPtr anonymousToken;
     GstRTSPMountPointsPtr mountPoints;
 
+    struct DecodedTapInfo
+    {
+        std::unique_ptr<DecodedTap> tap;
+        unsigned refs;
+    };
+    std::map<std::string, DecodedTapInfo> decodedTaps;
+
+    // should be destroyed before decoded taps and mount points
+    std::shared_ptr<ShmEgress> shmEgress;
+
+    std::shared_ptr<Channel> acquireShmPath(const std::string& path);
+    void releaseShmPath(const std::string& path);
+
     std::map<const GstRTSPClient*, ClientInfo> clients;
     std::map<std::string, PathInfo> paths;
 
+    std::deque<GstRTSPClient*> closedClients;
+    GSource* closedClientsSource = nullptr;
+
+    // guards users and sessions since stats could be requested from any thread
+    mutable std::mutex usersMutex;
+    std::map<std::string, UserInfo> users;
+    std::map<SessionKey, SessionInfo> sessions;
+
+    std::shared_ptr<PathDirectory> pathDirectory;
+
+    std::map<std::string, std::unique_ptr<IngestMirror>> mirrors;
+
+    // paths published through SRT and WHIP listeners
+    std::set<std::string> ingestRecordingPaths;
+
+    // should be destroyed first since SRT and WHIP publishers are accounted above
+    std::map<unsigned short, std::shared_ptr<SrtIngest>> srtIngests;
+    std::map<unsigned short, std::shared_ptr<WhipIngest>> whipIngests;
+
     inline const gchar* user(const GstRTSPContext*) const;
 
     bool isRecording(const GstRTSPClient* client, const std::string& path);
@@ -71,21 +186,60 @@ struct Server::Private
     void onClientConnected(GstRTSPClient*);
 
 #if ENABLE_LIMITS
-    GstRTSPStatusCode beforePlay(const GstRTSPClient*, const GstRTSPUrl*, const gchar* sessionId);
-    GstRTSPStatusCode beforeRecord(const GstRTSPClient*, const GstRTSPUrl*, const gchar* sessionId);
+    GstRTSPStatusCode beforePlay(const GstRTSPClient*, const GstRTSPContext*, const gchar* sessionId);
+    GstRTSPStatusCode beforeRecord(const GstRTSPClient*, const GstRTSPContext*, const gchar* sessionId);
+    GstRTSPStatusCode checkUserQuota(
+        const GstRTSPClient*,
+        const GstRTSPContext*,
+        const gchar* sessionId,
+        bool record);
 #endif
+    GstRTSPStatusCode checkUserQuota(
+        const SessionKey&,
+        const std::string& user,
+        const std::string& path,
+        const Channels& channels,
+        bool record);
+
+    Channels playedChannels(const GstRTSPContext*);
+
+    void userSessionStarted(
+        const GstRTSPClient*,
+        const GstRTSPContext*,
+        const gchar* sessionId,
+        bool record);
+    void userSessionStarted(
+        const SessionKey&,
+        const std::string& user,
+        bool record,
+        const Channels& channels);
+    void userSessionFinished(const SessionKey&);
 
     void onPlay(const GstRTSPClient*, const GstRTSPContext*, const gchar* sessionId);
     void onRecord(const GstRTSPClient*, const GstRTSPContext*, const gchar* sessionId);
     void onTeardown(const GstRTSPClient*, const GstRTSPUrl*, const gchar* sessionId);
 
-    void onClientClosed(const GstRTSPClient*);
+    void onClientClosed(GstRTSPClient*);
+    bool cleanupClosedClients();
+    void cleanupClient(
+        const GstRTSPClient*,
+        std::set<std::string>* lastPlayerPaths,
+        std::set<std::string>* recorderPaths);
 
     void firstPlayerConnected(const GstRTSPContext* ctx, const std::string& path);
     void lastPlayerDisconnected(const std::string& path);
 
-    void recorderConnected(const GstRTSPContext* ctx, const std::string& path);
+    void recorderConnected(const std::string& user, const std::string& path);
     void recorderDisconnected(const std::string& path);
+
+    bool ingestAuthorize(
+        const std::string& user,
+        const std::string& password,
+        const std::string& path);
+    std::shared_ptr<Channel> ingestStartRecord(
+        const std::string& user,
+        const std::string& path);
+    void ingestStopRecord(const std::string& path);
 };
 
 
@@ -108,6 +262,14 @@ Server::Private::Private(
 {
 }
 
+Server::Private::~Private()
+{
+    RestreamServerLib::Private::DestroySource(&closedClientsSource);
+
+    for(GstRTSPClient* client: closedClients)
+        g_object_unref(client);
+}
+
 const gchar* Server::Private::user(const GstRTSPContext* ctx) const
 {
     return
@@ -140,15 +302,34 @@ void Server::Private::lastPlayerDisconnected(
 }
 
 void Server::Private::recorderConnected(
-    const GstRTSPContext* ctx,
+    const std::string& user,
     const std::string& path)
 {
     Log()->debug(
         "Recorder connected. Path: {}",
         path);
 
+    // sub stream follows main one
+    if(pathDirectory && !IsSubPath(path))
+        pathDirectory->announce(path);
+
+    const std::string mirrorUrl =
+        callbacks.mirrorUrl ? callbacks.mirrorUrl(user, path) : std::string();
+    const std::shared_ptr<Channel> channel =
+        mirrorUrl.empty() ?
+            nullptr :
+            rtsp_mount_points_get_channel(_RTSP_MOUNT_POINTS(mountPoints.get()), path);
+    if(channel) {
+        const std::string recordUrl =
+            mirrorUrl + path + "?" + RestreamServerLib::Private::RecordSuffix;
+        std::unique_ptr<IngestMirror> mirror(new IngestMirror(channel, recordUrl));
+        // connection is retried on failure
+        mirror->start();
+        mirrors[path] = std::move(mirror);
+    }
+
     if(callbacks.recorderConnected)
-        callbacks.recorderConnected(user(ctx), path);
+        callbacks.recorderConnected(user, path);
 }
 
 void Server::Private::recorderDisconnected(
@@ -158,12 +339,20 @@ void Server::Private::recorderDisconnected(
         "Recorder disconnected. Path: {}",
         path);
 
+    if(pathDirectory && !IsSubPath(path))
+        pathDirectory->withdraw(path);
+
+    mirrors.erase(path);
+
     if(callbacks.recorderDisconnected)
         callbacks.recorderDisconnected(path);
 }
 
 bool Server::Private::isRecording(const GstRTSPClient* client, const std::string& path)
 {
+    if(ingestRecordingPaths.end() != ingestRecordingPaths.find(path))
+        return true;
+
     auto pathIt = paths.find(path);
     if(paths.end() == pathIt)
         return false;
@@ -216,7 +405,7 @@ void Server::Private::onClientConnected(GstRTSPClient* client)
                 static_cast<Private*>(userData);
             const gchar* sessionId =
                 gst_rtsp_session_get_sessionid(context->session);
-            return p->beforePlay(client, context->uri, sessionId);
+            return p->beforePlay(client, context, sessionId);
         };
     g_signal_connect(client, "pre-play-request", GCallback(prePlayCallback), this);
 #endif
@@ -239,7 +428,7 @@ void Server::Private::onClientConnected(GstRTSPClient* client)
                 static_cast<Private*>(userData);
             const gchar* sessionId =
                 gst_rtsp_session_get_sessionid(context->session);
-            return p->beforeRecord(client, context->uri, sessionId);
+            return p->beforeRecord(client, context, sessionId);
         };
     g_signal_connect(client, "pre-record-request", GCallback(preRecordCallback), this);
 #endif
@@ -276,28 +465,30 @@ void Server::Private::onClientConnected(GstRTSPClient* client)
 #if ENABLE_LIMITS
 GstRTSPStatusCode Server::Private::beforePlay(
     const GstRTSPClient* client,
-    const GstRTSPUrl* url,
+    const GstRTSPContext* ctx,
     const gchar* sessionId)
 {
+    const GstRTSPUrl* url = ctx->uri;
+
     Log()->debug(
         "Server.beforePlay."
         " client: {}, path: {}, sessionId: {}",
         static_cast<const void*>(client), url->abspath, sessionId);
 
-    const std::string path = url->abspath;
-
-    auto pathIt = paths.find(path);
-    if(maxClientsPerPath > 0 && paths.end() != pathIt) {
-        if(pathIt->second.playCount >= (maxClientsPerPath - 1)) {
-            Log()->error(
-                "Max players count limit reached. "
-                "client: {}, path: {}, sessionId: {}",
-                static_cast<const void*>(client), url->abspath, sessionId);
-            return GST_RTSP_STS_FORBIDDEN;
+    for(const std::string& path: UrlPaths(ctx->method, url)) {
+        auto pathIt = paths.find(path);
+        if(maxClientsPerPath > 0 && paths.end() != pathIt) {
+            if(pathIt->second.playCount >= (maxClientsPerPath - 1)) {
+                Log()->error(
+                    "Max players count limit reached. "
+                    "client: {}, path: {}, sessionId: {}",
+                    static_cast<const void*>(client), path, sessionId);
+                return GST_RTSP_STS_FORBIDDEN;
+            }
         }
     }
 
-    return GST_RTSP_STS_OK;
+    return checkUserQuota(client, ctx, sessionId, false);
 }
 #endif
 
@@ -311,35 +502,199 @@ void Server::Private::onPlay(
         " client: {}, path: {}, sessionId: {}",
         static_cast<const void*>(client), ctx->uri->abspath, sessionId);
 
-    const std::string path = ctx->uri->abspath;
+    userSessionStarted(client, ctx, sessionId, false);
 
-    PathInfo& pathInfo = registerPath(client, path);
-    ++pathInfo.playCount;
-    if(1 == pathInfo.playCount)
-        firstPlayerConnected(ctx, path);
+    for(const std::string& path: UrlPaths(ctx->method, ctx->uri)) {
+        PathInfo& pathInfo = registerPath(client, path);
+        ++pathInfo.playCount;
+        if(1 == pathInfo.playCount)
+            firstPlayerConnected(ctx, path);
+    }
 }
 
 #if ENABLE_LIMITS
 GstRTSPStatusCode Server::Private::beforeRecord(
     const GstRTSPClient* client,
-    const GstRTSPUrl* url,
+    const GstRTSPContext* ctx,
     const gchar* sessionId)
 {
+    const GstRTSPUrl* url = ctx->uri;
+
     Log()->debug(
         "Server.beforeRecord."
         " client: {}, path: {}, sessionId: {}",
         static_cast<const void*>(client), url->abspath, sessionId);
 
-    if(isRecording(client, url->abspath)) {
+    if(isRecording(client, UrlPaths(ctx->method, url).front())) {
         Log()->info(
             "Second record on the same path. client: {}, path: {}",
             static_cast<const void*>(client), url->abspath);
         return GST_RTSP_STS_SERVICE_UNAVAILABLE;
     } else
-       return GST_RTSP_STS_OK;
+       return checkUserQuota(client, ctx, sessionId, true);
+}
+
+GstRTSPStatusCode Server::Private::checkUserQuota(
+    const GstRTSPClient* client,
+    const GstRTSPContext* ctx,
+    const gchar* sessionId,
+    bool record)
+{
+    if(!callbacks.userQuota)
+        return GST_RTSP_STS_OK;
+
+    const std::string user = this->user(ctx);
+    const std::string path = ctx->uri->abspath;
+
+    return
+        checkUserQuota(
+            SessionKey(client, sessionId),
+            user,
+            path,
+            record ? Channels() : playedChannels(ctx),
+            record);
 }
 #endif
 
+// channels of every path played with url, including tiles of aggregate one
+Channels Server::Private::playedChannels(const GstRTSPContext* ctx)
+{
+    RtspMountPoints* mountPoints = _RTSP_MOUNT_POINTS(this->mountPoints.get());
+
+    Channels channels;
+    for(const std::string& path: UrlPaths(ctx->method, ctx->uri)) {
+        if(std::shared_ptr<Channel> channel = rtsp_mount_points_get_channel(mountPoints, path))
+            channels.push_back(channel);
+    }
+
+    return channels;
+}
+
+GstRTSPStatusCode Server::Private::checkUserQuota(
+    const SessionKey& sessionKey,
+    const std::string& user,
+    const std::string& path,
+    const Channels& channels,
+    bool record)
+{
+    if(!callbacks.userQuota)
+        return GST_RTSP_STS_OK;
+
+    const UserQuota quota = callbacks.userQuota(user);
+
+    std::lock_guard<std::mutex> lock(usersMutex);
+
+    // PLAY could be repeated for already started session
+    if(sessions.end() != sessions.find(sessionKey))
+        return GST_RTSP_STS_OK;
+
+    // user without active sessions is checked against empty usage,
+    // so the first session alone couldn't exceed quota either
+    static const UserInfo NoUsage;
+    const auto userIt = users.find(user);
+    const UserInfo& userInfo = users.end() == userIt ? NoUsage : userIt->second;
+
+    if(quota.maxSessions > 0 && userInfo.sessions >= quota.maxSessions) {
+        Log()->info(
+            "User sessions quota reached. user: {}, path: {}, sessions: {}",
+            user, path, userInfo.sessions);
+        return GST_RTSP_STS_FORBIDDEN;
+    }
+
+    if(record &&
+       quota.maxPublishedPaths > 0 &&
+       userInfo.publishedPaths >= quota.maxPublishedPaths)
+    {
+        Log()->info(
+            "User published paths quota reached. user: {}, path: {}, paths: {}",
+            user, path, userInfo.publishedPaths);
+        return GST_RTSP_STS_FORBIDDEN;
+    }
+
+    if(!record && !channels.empty() && quota.maxEgressBitrate > 0) {
+        unsigned playedBitrate = 0;
+        for(const std::shared_ptr<Channel>& channel: channels)
+            playedBitrate += channel->ingestBitrate();
+
+        const unsigned egressBitrate = EgressBitrate(userInfo);
+        if(egressBitrate + playedBitrate > quota.maxEgressBitrate) {
+            Log()->info(
+                "User egress bitrate quota reached. user: {}, path: {}, bitrate: {}",
+                user, path, egressBitrate);
+            return GST_RTSP_STS_NOT_ENOUGH_BANDWIDTH;
+        }
+    }
+
+    return GST_RTSP_STS_OK;
+}
+
+void Server::Private::userSessionStarted(
+    const GstRTSPClient* client,
+    const GstRTSPContext* ctx,
+    const gchar* sessionId,
+    bool record)
+{
+    const std::string user = this->user(ctx);
+
+    userSessionStarted(
+        SessionKey(client, sessionId),
+        user,
+        record,
+        record ? Channels() : playedChannels(ctx));
+}
+
+void Server::Private::userSessionStarted(
+    const SessionKey& sessionKey,
+    const std::string& user,
+    bool record,
+    const Channels& channels)
+{
+    std::lock_guard<std::mutex> lock(usersMutex);
+
+    const bool inserted =
+        sessions.emplace(
+            sessionKey,
+            SessionInfo { user, record, channels }).second;
+    if(!inserted)
+        return;
+
+    UserInfo& userInfo = users[user];
+    ++userInfo.sessions;
+    if(record)
+        ++userInfo.publishedPaths;
+    for(const std::shared_ptr<Channel>& channel: channels)
+        ++userInfo.playedChannels[channel];
+}
+
+void Server::Private::userSessionFinished(const SessionKey& sessionKey)
+{
+    std::lock_guard<std::mutex> lock(usersMutex);
+
+    auto sessionIt = sessions.find(sessionKey);
+    if(sessions.end() == sessionIt)
+        return;
+
+    const SessionInfo& sessionInfo = sessionIt->second;
+
+    auto userIt = users.find(sessionInfo.user);
+    if(users.end() != userIt) {
+        UserInfo& userInfo = userIt->second;
+        --userInfo.sessions;
+        if(sessionInfo.record)
+            --userInfo.publishedPaths;
+        for(const std::shared_ptr<Channel>& channel: sessionInfo.channels) {
+            auto channelIt = userInfo.playedChannels.find(channel);
+            if(userInfo.playedChannels.end() != channelIt && 0 == --channelIt->second)
+                userInfo.playedChannels.erase(channelIt);
+        }
+
+        if(0 == userInfo.sessions)
+            users.erase(userIt);
+    }
+
+    sessions.erase(sessionIt);
+}
+
 void Server::Private::onRecord(
     const GstRTSPClient* client,
     const GstRTSPContext* ctx,
@@ -350,7 +705,7 @@ void Server::Private::onRecord(
         "client: {}, path: {}, sessionId: {}",
         static_cast<const void*>(client), ctx->uri->abspath, sessionId);
 
-    const std::string path = ctx->uri->abspath;
+    const std::string path = UrlPaths(ctx->method, ctx->uri).front();
 
     PathInfo& pathInfo = registerPath(client, path);
     if(pathInfo.recordClient || !pathInfo.recordSessionId.empty()) {
@@ -361,7 +716,9 @@ void Server::Private::onRecord(
         pathInfo.recordClient = client;
         pathInfo.recordSessionId = sessionId;
 
-        recorderConnected(ctx, path);
+        userSessionStarted(client, ctx, sessionId, true);
+
+        recorderConnected(user(ctx), path);
     }
 }
 
@@ -375,44 +732,117 @@ void Server::Private::onTeardown(
         "client: {}, path: {}, sessionId: {}",
         static_cast<const void*>(client), url->abspath, sessionId);
 
-    const std::string path = url->abspath;
+    userSessionFinished(SessionKey(client, sessionId));
 
-    auto pathIt = paths.find(path);
-    if(paths.end() == pathIt) {
-        Log()->critical(
-            "Not registered path teardown. client: {}, path: {}",
-            static_cast<const void*>(client), url->abspath);
-        return;
-    }
+    for(const std::string& path: UrlPaths(GST_RTSP_TEARDOWN, url)) {
+        auto pathIt = paths.find(path);
+        if(paths.end() == pathIt) {
+            Log()->critical(
+                "Not registered path teardown. client: {}, path: {}",
+                static_cast<const void*>(client), path);
+            continue;
+        }
 
-    PathInfo& pathInfo = pathIt->second;
-    if(client == pathInfo.recordClient &&
-       sessionId == pathInfo.recordSessionId)
-    {
-        pathInfo.recordClient = nullptr;
-        pathInfo.recordSessionId.clear();
+        PathInfo& pathInfo = pathIt->second;
+        if(client == pathInfo.recordClient &&
+           sessionId == pathInfo.recordSessionId)
+        {
+            pathInfo.recordClient = nullptr;
+            pathInfo.recordSessionId.clear();
 
-        recorderDisconnected(path);
-    } else {
-        if(pathInfo.playCount > 0) {
-            --pathInfo.playCount;
-            if(0 == pathInfo.playCount)
-                lastPlayerDisconnected(path);
+            recorderDisconnected(path);
         } else {
-            Log()->critical(
-                "Not registered reader teardown. client: {}, path: {}",
-                static_cast<const void*>(client), url->abspath);
+            if(pathInfo.playCount > 0) {
+                --pathInfo.playCount;
+                if(0 == pathInfo.playCount)
+                    lastPlayerDisconnected(path);
+            } else {
+                Log()->critical(
+                    "Not registered reader teardown. client: {}, path: {}",
+                    static_cast<const void*>(client), path);
+            }
         }
     }
 }
 
-void Server::Private::onClientClosed(const GstRTSPClient* client)
+void Server::Private::onClientClosed(GstRTSPClient* client)
 {
     Log()->debug(
         "Server.clientClosed. "
         "client: {}",
         static_cast<const void*>(client));
 
+    // cleanup is postponed to let mass disconnects be handled in batches,
+    // reference is kept to not let client address be reused meanwhile
+    closedClients.push_back(GST_RTSP_CLIENT(g_object_ref(client)));
+
+    if(!closedClientsSource) {
+        auto cleanupCallback =
+            [] (gpointer userData) -> gboolean {
+                Private* p =
+                    static_cast<Private*>(userData);
+                return p->cleanupClosedClients() ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+            };
+        closedClientsSource =
+            RestreamServerLib::Private::AttachIdle(cleanupCallback, this);
+    }
+}
+
+bool Server::Private::cleanupClosedClients()
+{
+    std::set<std::string> lastPlayerPaths;
+    std::set<std::string> recorderPaths;
+
+    for(unsigned i = 0;
+        i < RestreamServerLib::Private::ClosedClientsBatchSize && !closedClients.empty();
+        ++i)
+    {
+        GstRTSPClient* client = closedClients.front();
+        closedClients.pop_front();
+
+        cleanupClient(client, &lastPlayerPaths, &recorderPaths);
+
+        g_object_unref(client);
+    }
+
+    Log()->debug(
+        "Server.cleanupClosedClients. "
+        "affected paths: {}, clients left: {}",
+        lastPlayerPaths.size() + recorderPaths.size(), closedClients.size());
+
+    for(const std::string& path: recorderPaths)
+        recorderDisconnected(path);
+
+    for(const std::string& path: lastPlayerPaths)
+        lastPlayerDisconnected(path);
+
+    if(closedClients.empty()) {
+        g_source_unref(closedClientsSource);
+        closedClientsSource = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void Server::Private::cleanupClient(
+    const GstRTSPClient* client,
+    std::set<std::string>* lastPlayerPaths,
+    std::set<std::string>* recorderPaths)
+{
+    std::vector<SessionKey> clientSessions;
+    {
+        std::lock_guard<std::mutex> lock(usersMutex);
+        for(auto it = sessions.lower_bound(SessionKey(client, std::string()));
+            it != sessions.end() && it->first.first == client;
+            ++it)
+        {
+            clientSessions.push_back(it->first);
+        }
+    }
+    for(const SessionKey& sessionKey: clientSessions)
+        userSessionFinished(sessionKey);
+
     const auto clientIt = clients.find(client);
     if(clients.end() != clientIt) {
         auto& refPaths = clientIt->second.refPaths;
@@ -429,7 +859,7 @@ void Server::Private::onClientClosed(const GstRTSPClient* client)
                         assert(pathInfo.playCount == 0 || pathInfo.playCount == 1);
                         if(1 == pathInfo.playCount) {
                             --pathInfo.playCount;
-                            lastPlayerDisconnected(path);
+                            lastPlayerPaths->insert(path);
                         }
                     } else {
                         assert(pathInfo.recordClient == client);
@@ -437,7 +867,7 @@ void Server::Private::onClientClosed(const GstRTSPClient* client)
                         pathInfo.recordClient = nullptr;
                         pathInfo.recordSessionId.clear();
 
-                        recorderDisconnected(path);
+                        recorderPaths->insert(path);
                     }
 
                     paths.erase(pathIt);
@@ -446,7 +876,7 @@ void Server::Private::onClientClosed(const GstRTSPClient* client)
                         pathInfo.recordClient = nullptr;
                         pathInfo.recordSessionId.clear();
 
-                        recorderDisconnected(path);
+                        recorderPaths->insert(path);
                     }
 
                     if(++refClients.begin() == refClients.end()) {
@@ -454,7 +884,7 @@ void Server::Private::onClientClosed(const GstRTSPClient* client)
                             assert(pathInfo.playCount == 0 || pathInfo.playCount == 1);
                             if(1 == pathInfo.playCount) {
                                 --pathInfo.playCount;
-                                lastPlayerDisconnected(path);
+                                lastPlayerPaths->insert(path);
                             }
                         }
                     }
@@ -467,7 +897,6 @@ void Server::Private::onClientClosed(const GstRTSPClient* client)
     }
 }
 
-
 Server::Server(
     const Callbacks& callbacks,
     unsigned short staticPort,
@@ -579,7 +1008,7 @@ void Server::initStaticServer()
 
 void Server::initRestreamServer(bool useTls)
 {
-    _p->restreamServer.reset(gst_rtsp_server_new());
+    _p->restreamServer.reset(GST_RTSP_SERVER(rtsp_server_new()));
 
     const AuthCallbacks authCallbacks {
         .tlsAuthenticate = _p->callbacks.tlsAuthenticate,
@@ -603,16 +1032,23 @@ void Server::initRestreamServer(bool useTls)
                 std::placeholders::_2,
                 std::placeholders::_3);
     };
+    mountPointsCallbacks.ingestLatency = _p->callbacks.ingestLatency;
+    mountPointsCallbacks.maxKeyframeAge = _p->callbacks.maxKeyframeAge;
 
     _p->mountPoints.reset(
         GST_RTSP_MOUNT_POINTS(
             rtsp_mount_points_new(
                 mountPointsCallbacks,
-                fmt::format("rtsp://localhost:{}/blue", _p->staticPort).c_str(),
                 _p->maxPathsCount,
                 _p->maxClientsPerPath)));
 
     GstRTSPServer* server = _p->restreamServer.get();
+
+    GstRTSPSessionPool* sessionPool =
+        GST_RTSP_SESSION_POOL(rtsp_session_pool_new());
+    gst_rtsp_server_set_session_pool(server, sessionPool);
+    g_object_unref(sessionPool);
+
     GstRTSPAuth* auth = _p->auth.get();
     GstRTSPMountPoints* mountPoints = _p->mountPoints.get();
     GstRTSPToken* anonymousToken = _p->anonymousToken.get();
@@ -674,4 +1110,311 @@ void Server::setTlsCertificate(GTlsCertificate* certificate)
     gst_rtsp_auth_set_tls_certificate(_p->auth.get(), certificate);
 }
 
+void Server::setSessionResumeWindow(unsigned seconds)
+{
+    std::shared_ptr<SessionResume> sessionResume;
+    if(seconds > 0)
+        sessionResume = std::make_shared<SessionResume>(seconds);
+
+    rtsp_server_set_session_resume(
+        _RTSP_SERVER(_p->restreamServer.get()),
+        sessionResume);
+    rtsp_auth_set_session_resume(
+        _RTSP_AUTH(_p->auth.get()),
+        sessionResume);
+}
+
+void Server::setViewersPerShard(unsigned viewersPerShard)
+{
+    rtsp_mount_points_set_viewers_per_shard(
+        _RTSP_MOUNT_POINTS(_p->mountPoints.get()),
+        viewersPerShard);
+}
+
+void Server::setFecOverhead(unsigned percentage)
+{
+    rtsp_mount_points_set_fec_overhead(
+        _RTSP_MOUNT_POINTS(_p->mountPoints.get()),
+        percentage);
+}
+
+bool Server::addPersistentPath(const std::string& path)
+{
+    GstRTSPThreadPool* threadPool =
+        gst_rtsp_server_get_thread_pool(_p->restreamServer.get());
+
+    const bool added =
+        rtsp_mount_points_add_persistent_path(
+            _RTSP_MOUNT_POINTS(_p->mountPoints.get()),
+            path,
+            threadPool,
+            _p->restreamPort);
+
+    g_object_unref(threadPool);
+
+    return added;
+}
+
+Stats Server::stats() const
+{
+    Stats stats;
+    stats.busMessagesPerSecond = RestreamServerLib::Private::DispatchedBusMessagesRate();
+
+    std::lock_guard<std::mutex> lock(_p->usersMutex);
+
+    for(const auto& pair: _p->users) {
+        const UserInfo& userInfo = pair.second;
+        UserUsage& usage = stats.users[pair.first];
+        usage.sessions = userInfo.sessions;
+        usage.publishedPaths = userInfo.publishedPaths;
+        usage.egressBitrate = EgressBitrate(userInfo);
+    }
+
+    return stats;
+}
+
+std::shared_ptr<Channel> Server::Private::acquireShmPath(const std::string& shmPath)
+{
+    RtspMountPoints* mountPoints = _RTSP_MOUNT_POINTS(this->mountPoints.get());
+
+    bool decoded;
+    const std::string path = ShmPathToPath(shmPath, &decoded);
+
+    DecodedTapConfig tapConfig;
+    if(decoded && (!callbacks.decodedTap || !callbacks.decodedTap(path, &tapConfig)))
+        return nullptr;
+
+    if(!rtsp_mount_points_ref_path(mountPoints, path))
+        return nullptr;
+
+    const std::shared_ptr<Channel> channel =
+        rtsp_mount_points_get_channel(mountPoints, path);
+    if(!decoded)
+        return channel;
+
+    DecodedTapInfo& tapInfo = decodedTaps[path];
+    if(!tapInfo.tap) {
+        tapInfo.tap = DecodedTap::create(channel, tapConfig);
+        tapInfo.refs = 0;
+    }
+    ++tapInfo.refs;
+
+    if(!tapInfo.tap) {
+        releaseShmPath(shmPath);
+        return nullptr;
+    }
+
+    return tapInfo.tap->frames();
+}
+
+void Server::Private::releaseShmPath(const std::string& shmPath)
+{
+    RtspMountPoints* mountPoints = _RTSP_MOUNT_POINTS(this->mountPoints.get());
+
+    bool decoded;
+    const std::string path = ShmPathToPath(shmPath, &decoded);
+
+    if(decoded) {
+        auto it = decodedTaps.find(path);
+        if(it != decodedTaps.end() && 0 == --(it->second.refs))
+            decodedTaps.erase(it);
+    }
+
+    rtsp_mount_points_unref_path(mountPoints, path);
+}
+
+bool Server::startShmEgress(const std::string& socketPath)
+{
+    if(_p->shmEgress)
+        return false;
+
+    ShmEgress::Callbacks callbacks;
+    callbacks.acquirePath =
+        std::bind(&Private::acquireShmPath, _p.get(), std::placeholders::_1);
+    callbacks.releasePath =
+        std::bind(&Private::releaseShmPath, _p.get(), std::placeholders::_1);
+
+    std::shared_ptr<ShmEgress> shmEgress = std::make_shared<ShmEgress>(callbacks);
+    if(!shmEgress->listen(socketPath))
+        return false;
+
+    _p->shmEgress = shmEgress;
+
+    return true;
+}
+
+
+bool Server::Private::ingestAuthorize(
+    const std::string& user,
+    const std::string& password,
+    const std::string& path)
+{
+    const bool authenticationRequired =
+        callbacks.authenticationRequired &&
+        callbacks.authenticationRequired(GST_RTSP_RECORD, path, true);
+
+    if(authenticationRequired &&
+       (!callbacks.authenticate || !callbacks.authenticate(user, password)))
+    {
+        return false;
+    }
+
+    if(callbacks.authorize) {
+        return
+            callbacks.authorize(user, Action::ACCESS, path, true) &&
+            callbacks.authorize(user, Action::CONSTRUCT, path, true);
+    }
+
+    return true;
+}
+
+std::shared_ptr<Channel> Server::Private::ingestStartRecord(
+    const std::string& user,
+    const std::string& path)
+{
+    RtspMountPoints* mountPoints = _RTSP_MOUNT_POINTS(this->mountPoints.get());
+
+    if(isRecording(nullptr, path)) {
+        Log()->info("Second record on the same path. Ingest path: {}", path);
+        return nullptr;
+    }
+
+    const SessionKey sessionKey(nullptr, IngestSessionPrefix + path);
+
+    if(GST_RTSP_STS_OK != checkUserQuota(sessionKey, user, path, Channels(), true))
+        return nullptr;
+
+    if(!rtsp_mount_points_acquire_path(mountPoints, path))
+        return nullptr;
+
+    ingestRecordingPaths.insert(path);
+
+    userSessionStarted(sessionKey, user, true, Channels());
+
+    recorderConnected(user, path);
+
+    return rtsp_mount_points_get_channel(mountPoints, path);
+}
+
+void Server::Private::ingestStopRecord(const std::string& path)
+{
+    if(0 == ingestRecordingPaths.erase(path))
+        return;
+
+    userSessionFinished(SessionKey(nullptr, IngestSessionPrefix + path));
+
+    recorderDisconnected(path);
+
+    rtsp_mount_points_unref_path(_RTSP_MOUNT_POINTS(mountPoints.get()), path);
+}
+
+bool Server::addSrtListener(unsigned short port, const std::string& defaultPath)
+{
+    if(_p->srtIngests.end() != _p->srtIngests.find(port))
+        return false;
+
+    SrtIngest::Callbacks callbacks;
+    callbacks.authorize =
+        std::bind(
+            &Private::ingestAuthorize, _p.get(),
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    callbacks.startRecord =
+        std::bind(
+            &Private::ingestStartRecord, _p.get(),
+            std::placeholders::_1, std::placeholders::_2);
+    callbacks.stopRecord =
+        std::bind(&Private::ingestStopRecord, _p.get(), std::placeholders::_1);
+    callbacks.latency = _p->callbacks.ingestLatency;
+
+    std::shared_ptr<SrtIngest> srtIngest =
+        std::make_shared<SrtIngest>(callbacks, port, defaultPath);
+    if(!srtIngest->start())
+        return false;
+
+    _p->srtIngests.emplace(port, srtIngest);
+
+    return true;
+}
+
+bool Server::addWhipListener(unsigned short port)
+{
+#if HAVE_GST_WEBRTC
+    if(_p->whipIngests.end() != _p->whipIngests.find(port))
+        return false;
+
+    WhipIngest::Callbacks callbacks;
+    callbacks.authorize =
+        std::bind(
+            &Private::ingestAuthorize, _p.get(),
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    callbacks.startRecord =
+        std::bind(
+            &Private::ingestStartRecord, _p.get(),
+            std::placeholders::_1, std::placeholders::_2);
+    callbacks.stopRecord =
+        std::bind(&Private::ingestStopRecord, _p.get(), std::placeholders::_1);
+
+    std::shared_ptr<WhipIngest> whipIngest =
+        std::make_shared<WhipIngest>(callbacks, port);
+    if(!whipIngest->start())
+        return false;
+
+    _p->whipIngests.emplace(port, whipIngest);
+
+    return true;
+#else
+    Log()->error("WHIP ingest requires gstreamer-webrtc. port: {}", port);
+    return false;
+#endif
+}
+
+
+bool Server::startPathDirectory(
+    const std::string& nodeUrl,
+    unsigned short gossipPort,
+    const std::vector<std::string>& peers,
+    const std::string& gossipAddress)
+{
+    if(_p->pathDirectory)
+        return false;
+
+    std::shared_ptr<PathDirectory> pathDirectory =
+        std::make_shared<PathDirectory>(nodeUrl);
+
+    for(const std::string& peer: peers) {
+        const std::string::size_type portPos = peer.rfind(':');
+        const guint64 port =
+            portPos != std::string::npos ?
+                g_ascii_strtoull(peer.c_str() + portPos + 1, nullptr, 10) :
+                0;
+        if(0 == port || port > G_MAXUINT16 ||
+           !pathDirectory->addPeer(peer.substr(0, portPos), port))
+        {
+            Log()->error("Invalid path directory peer: {}", peer);
+            return false;
+        }
+    }
+
+    if(!pathDirectory->listen(gossipPort, gossipAddress))
+        return false;
+
+    // paths already published here
+    for(const auto& pair: _p->paths) {
+        if(IsSubPath(pair.first))
+            continue;
+        if(pair.second.recordClient || !pair.second.recordSessionId.empty())
+            pathDirectory->announce(pair.first);
+    }
+    for(const std::string& path: _p->ingestRecordingPaths)
+        pathDirectory->announce(path);
+
+    _p->pathDirectory = pathDirectory;
+
+    rtsp_server_set_path_directory(
+        _RTSP_SERVER(_p->restreamServer.get()),
+        pathDirectory);
+
+    return true;
+}
+
 }
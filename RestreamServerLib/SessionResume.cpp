@@ -0,0 +1,133 @@
+#include "SessionResume.h"
+
+#include <random>
+
+#include <glib.h>
+
+#include "Log.h"
+
+
+namespace RestreamServerLib
+{
+
+SessionResume::SessionResume(unsigned window) :
+    _window(window)
+{
+}
+
+bool SessionResume::isExpired(const Entry& entry, gint64 now)
+{
+    return entry.expiresAt != 0 && entry.expiresAt <= now;
+}
+
+void SessionResume::removeExpired(gint64 now)
+{
+    for(auto it = _entries.begin(); it != _entries.end();) {
+        if(isExpired(it->second, now))
+            it = _entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::string SessionResume::issue(const std::string& user, const std::string& path)
+{
+    // token grants access, so it shouldn't be predictable
+    std::random_device random;
+    const std::string token =
+        fmt::format(
+            "{:08x}{:08x}{:08x}{:08x}",
+            random(), random(), random(), random());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    removeExpired(g_get_monotonic_time());
+
+    Entry entry;
+    entry.user = user;
+    entry.path = path;
+    entry.expiresAt = 0;
+    entry.claimedBy = nullptr;
+    _entries.emplace(token, entry);
+
+    return token;
+}
+
+void SessionResume::revoke(const std::string& token)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _entries.erase(token);
+}
+
+void SessionResume::release(const std::string& token)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(token);
+    if(it != _entries.end())
+        it->second.expiresAt = g_get_monotonic_time() + _window * G_USEC_PER_SEC;
+}
+
+bool SessionResume::claim(
+    const std::string& token,
+    const GstRTSPClient* client,
+    std::string* user,
+    std::string* path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(token);
+    if(it == _entries.end())
+        return false;
+
+    Entry& entry = it->second;
+    if(entry.expiresAt == 0 || isExpired(entry, g_get_monotonic_time()))
+        return false;
+
+    if(entry.claimedBy && entry.claimedBy != client)
+        return false;
+
+    entry.claimedBy = client;
+
+    if(user)
+        *user = entry.user;
+    if(path)
+        *path = entry.path;
+
+    return true;
+}
+
+bool SessionResume::consume(
+    const std::string& token,
+    const GstRTSPClient* client,
+    const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(token);
+    if(it == _entries.end() ||
+       it->second.claimedBy != client ||
+       it->second.path != path)
+    {
+        return false;
+    }
+
+    _entries.erase(it);
+
+    return true;
+}
+
+void SessionResume::drop(const GstRTSPClient* client)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for(auto it = _entries.begin(); it != _entries.end();) {
+        if(it->second.claimedBy == client)
+            it = _entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+}
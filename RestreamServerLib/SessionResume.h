@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+
+#include <gst/rtsp-server/rtsp-client.h>
+
+
+namespace RestreamServerLib
+{
+
+// Keeps tokens issued to players on PLAY,
+// so reconnecting player could restore authentication and authorization
+// of the previous connection during resume window.
+// Token is single use: it's usable only after connection it was issued to
+// is closed, only from one connection, and is spent on successful PLAY
+// (new token is issued then) or when that connection is closed.
+class SessionResume
+{
+public:
+    SessionResume(unsigned window);
+
+    // in seconds
+    unsigned window() const
+        { return _window; }
+
+    std::string issue(const std::string& user, const std::string& path);
+    // token is not usable anymore
+    void revoke(const std::string& token);
+    // starts resume window for token,
+    // should be called when connection token was issued to is closed
+    void release(const std::string& token);
+
+    // binds released and not expired token to client on first use,
+    // returns false if token was bound to another client already
+    bool claim(
+        const std::string& token,
+        const GstRTSPClient*,
+        std::string* user,
+        std::string* path);
+    // spends token claimed by client for path,
+    // returns false if there is no such token
+    bool consume(
+        const std::string& token,
+        const GstRTSPClient*,
+        const std::string& path);
+    // spends all tokens claimed by client
+    void drop(const GstRTSPClient*);
+
+private:
+    struct Entry
+    {
+        std::string user;
+        std::string path;
+        gint64 expiresAt; // 0 while token is used by connected client
+        const GstRTSPClient* claimedBy;
+    };
+
+    static bool isExpired(const Entry&, gint64 now);
+    void removeExpired(gint64 now);
+
+private:
+    const unsigned _window;
+
+    mutable std::mutex _mutex;
+    std::map<std::string, Entry> _entries;
+};
+
+}
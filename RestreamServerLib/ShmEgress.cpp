@@ -0,0 +1,269 @@
+#include "ShmEgress.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+#include <gio/gunixconnection.h>
+
+#include "Log.h"
+
+
+namespace RestreamServerLib
+{
+
+enum {
+    MaxPathLength = 1024,
+};
+
+struct ShmEgress::Consumer
+{
+    ~Consumer();
+
+    std::weak_ptr<ShmEgress> owner;
+    GSocketConnection* connection;
+    GDataInputStream* input;
+    std::string path;
+};
+
+ShmEgress::Consumer::~Consumer()
+{
+    g_object_unref(input);
+    g_io_stream_close(G_IO_STREAM(connection), nullptr, nullptr);
+    g_object_unref(connection);
+}
+
+ShmEgress::ShmEgress(const Callbacks& callbacks) :
+    _callbacks(callbacks),
+    _service(nullptr),
+    _cancellable(g_cancellable_new())
+{
+}
+
+ShmEgress::~ShmEgress()
+{
+    g_cancellable_cancel(_cancellable);
+    g_object_unref(_cancellable);
+
+    if(_service) {
+        g_socket_service_stop(_service);
+        g_socket_listener_close(G_SOCKET_LISTENER(_service));
+        g_object_unref(_service);
+
+        g_unlink(_socketPath.c_str());
+    }
+
+    if(_callbacks.releasePath) {
+        for(const auto& pair: _rings) {
+            for(unsigned i = 0; i < pair.second.consumers; ++i)
+                _callbacks.releasePath(pair.first);
+        }
+    }
+}
+
+bool ShmEgress::listen(const std::string& socketPath)
+{
+    if(_service)
+        return false;
+
+    // socket left from previous run
+    g_unlink(socketPath.c_str());
+
+    GSocketAddress* address = g_unix_socket_address_new(socketPath.c_str());
+
+    _service = g_socket_service_new();
+
+    GError* error = nullptr;
+    const gboolean added =
+        g_socket_listener_add_address(
+            G_SOCKET_LISTENER(_service),
+            address,
+            G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_DEFAULT,
+            nullptr, nullptr, &error);
+    g_object_unref(address);
+
+    if(!added) {
+        Log()->error(
+            "ShmEgress. Fail to listen on {}: {}",
+            socketPath, error->message);
+        g_error_free(error);
+        g_object_unref(_service);
+        _service = nullptr;
+        return false;
+    }
+
+    _socketPath = socketPath;
+
+    // rings are not protected by authorization,
+    // so only server's user is allowed to connect
+    if(g_chmod(socketPath.c_str(), 0600) != 0) {
+        Log()->error(
+            "ShmEgress. Fail to restrict access to {}: {}",
+            socketPath, g_strerror(errno));
+        g_socket_listener_close(G_SOCKET_LISTENER(_service));
+        g_object_unref(_service);
+        _service = nullptr;
+        g_unlink(socketPath.c_str());
+        return false;
+    }
+
+    g_signal_connect(_service, "incoming", G_CALLBACK(onIncoming), this);
+    g_socket_service_start(_service);
+
+    Log()->info("ShmEgress. Listening on {}", socketPath);
+
+    return true;
+}
+
+gboolean ShmEgress::onIncoming(
+    GSocketService*,
+    GSocketConnection* connection,
+    GObject* /*sourceObject*/,
+    gpointer userData)
+{
+    ShmEgress* self = static_cast<ShmEgress*>(userData);
+
+    // connection could be accepted before socket permissions were restricted
+    GCredentials* credentials =
+        g_socket_get_credentials(g_socket_connection_get_socket(connection), nullptr);
+    const uid_t peerUid =
+        credentials ?
+            g_credentials_get_unix_user(credentials, nullptr) :
+            static_cast<uid_t>(-1);
+    if(credentials)
+        g_object_unref(credentials);
+    if(peerUid != getuid()) {
+        Log()->warn("ShmEgress. Connection of foreign user rejected");
+        g_io_stream_close(G_IO_STREAM(connection), nullptr, nullptr);
+        return TRUE;
+    }
+
+    Consumer* consumer = new Consumer;
+    consumer->owner = self->shared_from_this();
+    consumer->connection = G_SOCKET_CONNECTION(g_object_ref(connection));
+    consumer->input =
+        g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+
+    g_data_input_stream_read_line_async(
+        consumer->input,
+        G_PRIORITY_DEFAULT,
+        self->_cancellable,
+        onPathRead,
+        consumer);
+
+    return TRUE;
+}
+
+void ShmEgress::onPathRead(GObject* source, GAsyncResult* result, gpointer userData)
+{
+    Consumer* consumer = static_cast<Consumer*>(userData);
+
+    gsize length = 0;
+    gchar* line =
+        g_data_input_stream_read_line_finish(
+            G_DATA_INPUT_STREAM(source), result, &length, nullptr);
+
+    std::shared_ptr<ShmEgress> self = consumer->owner.lock();
+    if(!self || !line || length > MaxPathLength) {
+        g_free(line);
+        delete consumer;
+        return;
+    }
+
+    const std::string path = line;
+    g_free(line);
+
+    self->addConsumer(consumer, path);
+}
+
+void ShmEgress::addConsumer(Consumer* consumer, const std::string& path)
+{
+    const std::shared_ptr<Channel> channel =
+        _callbacks.acquirePath ? _callbacks.acquirePath(path) : nullptr;
+    if(!channel) {
+        Log()->info("ShmEgress. Unavailable path requested: {}", path);
+        delete consumer;
+        return;
+    }
+
+    consumer->path = path;
+
+    RingInfo& ringInfo = _rings[path];
+    if(!ringInfo.ring) {
+        ringInfo.ring = ShmRing::create(channel, "restream" + path);
+        ringInfo.consumers = 0;
+    }
+    ++ringInfo.consumers;
+
+    GError* error = nullptr;
+    if(!ringInfo.ring ||
+       !g_unix_connection_send_fd(
+            G_UNIX_CONNECTION(consumer->connection),
+            ringInfo.ring->fd(),
+            nullptr, &error))
+    {
+        Log()->error(
+            "ShmEgress. Fail to pass ring to consumer. path: {}, error: {}",
+            path, error ? error->message : "no ring");
+        if(error)
+            g_error_free(error);
+        removeConsumer(consumer);
+        return;
+    }
+
+    Log()->debug(
+        "ShmEgress. Consumer connected. path: {}, consumers: {}",
+        path, ringInfo.consumers);
+
+    // consumer is not expected to send anything else,
+    // so read completes when connection is closed
+    g_input_stream_read_bytes_async(
+        G_INPUT_STREAM(consumer->input),
+        1,
+        G_PRIORITY_DEFAULT,
+        _cancellable,
+        onConsumerRead,
+        consumer);
+}
+
+void ShmEgress::onConsumerRead(GObject* source, GAsyncResult* result, gpointer userData)
+{
+    Consumer* consumer = static_cast<Consumer*>(userData);
+
+    GBytes* bytes =
+        g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), result, nullptr);
+    if(bytes)
+        g_bytes_unref(bytes);
+
+    std::shared_ptr<ShmEgress> self = consumer->owner.lock();
+    if(!self) {
+        delete consumer;
+        return;
+    }
+
+    self->removeConsumer(consumer);
+}
+
+void ShmEgress::removeConsumer(Consumer* consumer)
+{
+    const std::string path = consumer->path;
+    delete consumer;
+
+    auto it = _rings.find(path);
+    if(it == _rings.end())
+        return;
+
+    Log()->debug(
+        "ShmEgress. Consumer disconnected. path: {}, consumers: {}",
+        path, it->second.consumers - 1);
+
+    if(0 == --(it->second.consumers))
+        _rings.erase(it);
+
+    if(_callbacks.releasePath)
+        _callbacks.releasePath(path);
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+
+#include <gio/gio.h>
+
+#include "ShmRing.h"
+
+
+namespace RestreamServerLib
+{
+
+// Shares encoded access units of paths with consumers on the same host
+// through shared memory rings (see ShmRingLayout).
+// Consumer connects to unix socket, sends path terminated with '\n'
+// and receives file descriptor of path's ring in reply,
+// connection is closed without reply if path is not available.
+// Ring is kept while at least one consumer keeps connection open.
+// Paths are not authorized, so socket is accessible
+// to the user server is running as only.
+// Should be used from thread running main context it was created on.
+class ShmEgress : public std::enable_shared_from_this<ShmEgress>
+{
+public:
+    struct Callbacks
+    {
+        // returns nullptr if path is not available
+        std::function<std::shared_ptr<Channel> (const std::string& path)> acquirePath;
+        std::function<void (const std::string& path)> releasePath;
+    };
+
+    ShmEgress(const Callbacks&);
+    ~ShmEgress();
+
+    bool listen(const std::string& socketPath);
+
+private:
+    struct Consumer;
+
+    // returns TRUE since connection is always handled here
+    static gboolean onIncoming(
+        GSocketService*,
+        GSocketConnection*,
+        GObject* sourceObject,
+        gpointer userData);
+    static void onPathRead(GObject* source, GAsyncResult*, gpointer userData);
+    static void onConsumerRead(GObject* source, GAsyncResult*, gpointer userData);
+
+    void addConsumer(Consumer*, const std::string& path);
+    void removeConsumer(Consumer*);
+
+private:
+    const Callbacks _callbacks;
+
+    GSocketService* _service;
+    GCancellable* _cancellable;
+    std::string _socketPath;
+
+    struct RingInfo
+    {
+        std::shared_ptr<ShmRing> ring;
+        unsigned consumers;
+    };
+    std::map<std::string, RingInfo> _rings;
+};
+
+}
@@ -0,0 +1,212 @@
+#include "ShmRing.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <string>
+
+#include "Log.h"
+#include "Private.h"
+
+// since Linux 5.1
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+
+namespace RestreamServerLib
+{
+
+using namespace ShmRingLayout;
+
+std::shared_ptr<ShmRing> ShmRing::create(
+    const std::shared_ptr<Channel>& channel,
+    const std::string& name,
+    uint32_t slotsCount,
+    uint64_t dataSize)
+{
+    const size_t memorySize = DataOffset(slotsCount) + dataSize;
+
+    const int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if(fd < 0) {
+        Log()->error("ShmRing. memfd_create failed: {}", g_strerror(errno));
+        return nullptr;
+    }
+
+    if(ftruncate(fd, memorySize) != 0) {
+        Log()->error("ShmRing. ftruncate failed: {}", g_strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    void* memory = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(MAP_FAILED == memory) {
+        Log()->error("ShmRing. mmap failed: {}", g_strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    // consumers should not be able to make writer fault,
+    // and nobody but writer's own mapping should be able to write
+    if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE) != 0) {
+        Log()->warn(
+            "ShmRing. Fail to seal future writes: {}",
+            g_strerror(errno));
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL);
+
+    // separate open file description without write access is shared,
+    // so consumers couldn't map it writable
+    const std::string fdPath = "/proc/self/fd/" + std::to_string(fd);
+    const int readOnlyFd = open(fdPath.c_str(), O_RDONLY | O_CLOEXEC);
+    close(fd);
+    if(readOnlyFd < 0) {
+        Log()->error("ShmRing. Fail to reopen ring read only: {}", g_strerror(errno));
+        munmap(memory, memorySize);
+        return nullptr;
+    }
+
+    std::shared_ptr<ShmRing> ring(
+        new ShmRing(channel, readOnlyFd, memory, memorySize, slotsCount, dataSize));
+
+    ring->_listenerId =
+        channel->addListener(std::bind(&ShmRing::drain, ring.get()));
+    if(ring->_listenerId == Channel::InvalidListener)
+        return nullptr;
+
+    ring->drain();
+
+    return ring;
+}
+
+ShmRing::ShmRing(
+    const std::shared_ptr<Channel>& channel,
+    int fd, void* memory, size_t memorySize,
+    uint32_t slotsCount, uint64_t dataSize) :
+    _channel(channel), _listenerId(Channel::InvalidListener), _drainRequests(0),
+    _fd(fd), _memory(memory), _memorySize(memorySize),
+    _slotsCount(slotsCount), _dataSize(dataSize),
+    _seq(0), _writePos(0), _caps(nullptr)
+{
+    // memfd is zero filled, so atomics are already zeroed
+    Header* header = this->header();
+    header->magic = Magic;
+    header->version = Version;
+    header->slotsCount = slotsCount;
+    header->dataSize = dataSize;
+}
+
+ShmRing::~ShmRing()
+{
+    if(_listenerId != Channel::InvalidListener)
+        _channel->removeListener(_listenerId);
+
+    munmap(_memory, _memorySize);
+    close(_fd);
+
+    if(_caps)
+        gst_caps_unref(_caps);
+}
+
+Header* ShmRing::header() const
+{
+    return static_cast<Header*>(_memory);
+}
+
+Slot* ShmRing::slot(uint64_t seq) const
+{
+    Slot* slots =
+        reinterpret_cast<Slot*>(static_cast<uint8_t*>(_memory) + SlotsOffset());
+    return &slots[seq % _slotsCount];
+}
+
+uint8_t* ShmRing::data() const
+{
+    return static_cast<uint8_t*>(_memory) + DataOffset(_slotsCount);
+}
+
+void ShmRing::drain()
+{
+    Private::CombineDrains(
+        &_drainRequests,
+        [this] () {
+            while(GstSample* sample = _channel->pull(_listenerId)) {
+                write(sample);
+                gst_sample_unref(sample);
+            }
+        });
+}
+
+void ShmRing::writeCaps(GstCaps* caps)
+{
+    if(_caps && gst_caps_is_equal(_caps, caps))
+        return;
+
+    gst_caps_replace(&_caps, caps);
+
+    gchar* capsString = gst_caps_to_string(caps);
+
+    Header* header = this->header();
+    header->capsSeq.fetch_add(1);
+    g_strlcpy(header->caps, capsString, MaxCapsSize);
+    header->capsSeq.fetch_add(1);
+
+    g_free(capsString);
+}
+
+void ShmRing::write(GstSample* sample)
+{
+    if(GstCaps* caps = gst_sample_get_caps(sample))
+        writeCaps(caps);
+
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if(!buffer)
+        return;
+
+    const gsize size = gst_buffer_get_size(buffer);
+    if(size > _dataSize / 4) {
+        Log()->warn("ShmRing. Too big unit dropped. size: {}", size);
+        return;
+    }
+
+    Header* header = this->header();
+
+    // unit is never split at the end of data area
+    uint64_t dataOffset = _writePos;
+    if(dataOffset % _dataSize + size > _dataSize)
+        dataOffset += _dataSize - dataOffset % _dataSize;
+
+    const uint64_t seq = ++_seq;
+    Slot* slot = this->slot(seq);
+
+    slot->seq.store(0);
+    // readers of overwritten units should notice it before data is touched
+    _writePos = dataOffset + size;
+    header->writePos.store(_writePos);
+
+    gst_buffer_extract(buffer, 0, data() + dataOffset % _dataSize, size);
+
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    GstClockTime dts = GST_BUFFER_DTS(buffer);
+    const GstSegment* segment = gst_sample_get_segment(sample);
+    if(segment && segment->format == GST_FORMAT_TIME) {
+        pts = gst_segment_to_running_time(segment, GST_FORMAT_TIME, pts);
+        dts = gst_segment_to_running_time(segment, GST_FORMAT_TIME, dts);
+    }
+
+    slot->dataOffset = dataOffset;
+    slot->size = size;
+    slot->flags =
+        GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ? 0 : UnitKeyframe;
+    slot->pts = pts;
+    slot->dts = dts;
+    slot->seq.store(seq);
+
+    header->head.store(seq);
+}
+
+}
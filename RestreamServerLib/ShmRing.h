@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// Layout of shared memory ring, consumers get read only descriptor
+// and so could map it read only.
+// Unit with sequence number N is described by slot N % slotsCount,
+// it's data is at dataOffset % dataSize of data area.
+// Reader could use unit in place and then has to check
+// slot's seq is still N and writePos - dataOffset <= dataSize,
+// otherwise unit was overwritten meanwhile.
+namespace ShmRingLayout
+{
+
+const uint32_t Magic = 0x52535452; // "RSTR"
+const uint32_t Version = 1;
+
+enum {
+    MaxCapsSize = 1024,
+};
+
+enum UnitFlags : uint32_t {
+    UnitKeyframe = 1,
+};
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotsCount;
+    uint32_t reserved;
+    uint64_t dataSize;
+
+    std::atomic<uint64_t> head; // seq of the latest complete unit, 0 if none
+    std::atomic<uint64_t> writePos; // total bytes ever reserved in data area
+
+    std::atomic<uint64_t> capsSeq; // odd while caps are being written
+    char caps[MaxCapsSize]; // serialized GstCaps
+};
+
+struct Slot
+{
+    std::atomic<uint64_t> seq; // 0 while slot is being written
+    uint64_t dataOffset;
+    uint32_t size;
+    uint32_t flags;
+    uint64_t pts; // running time in shared clock domain, ns
+    uint64_t dts;
+};
+
+// Header, then slotsCount of Slot, then dataSize bytes of data
+inline size_t SlotsOffset()
+    { return (sizeof(Header) + 63) & ~size_t(63); }
+inline size_t DataOffset(uint32_t slotsCount)
+    { return (SlotsOffset() + sizeof(Slot) * slotsCount + 63) & ~size_t(63); }
+
+}
+
+// Writer side of shared memory ring fed from channel
+class ShmRing
+{
+public:
+    enum {
+        DefaultSlotsCount = 256,
+        DefaultDataSize = 16 * 1024 * 1024,
+    };
+
+    static std::shared_ptr<ShmRing> create(
+        const std::shared_ptr<Channel>&,
+        const std::string& name,
+        uint32_t slotsCount = DefaultSlotsCount,
+        uint64_t dataSize = DefaultDataSize);
+    ~ShmRing();
+
+    // read only descriptor of sealed memfd, valid while ring is alive
+    int fd() const
+        { return _fd; }
+
+private:
+    ShmRing(
+        const std::shared_ptr<Channel>&,
+        int fd, void* memory, size_t memorySize,
+        uint32_t slotsCount, uint64_t dataSize);
+
+    void drain();
+    void write(GstSample*);
+    void writeCaps(GstCaps*);
+
+    ShmRingLayout::Header* header() const;
+    ShmRingLayout::Slot* slot(uint64_t seq) const;
+    uint8_t* data() const;
+
+private:
+    const std::shared_ptr<Channel> _channel;
+    Channel::ListenerId _listenerId;
+    std::atomic<unsigned> _drainRequests;
+
+    const int _fd;
+    void* const _memory;
+    const size_t _memorySize;
+    const uint32_t _slotsCount;
+    const uint64_t _dataSize;
+
+    // accessed from draining thread only,
+    // nothing is read back from shared memory
+    uint64_t _seq;
+    uint64_t _writePos;
+    GstCaps* _caps;
+};
+
+}
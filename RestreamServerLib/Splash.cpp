@@ -0,0 +1,207 @@
+#include "Splash.h"
+
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include <CxxPtr/GlibPtr.h>
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+struct Splash::Params
+{
+    gint width;
+    gint height;
+    gint framerateNum;
+    gint framerateDen;
+    std::string profile;
+
+    std::string key() const
+    {
+        return
+            fmt::format(
+                "{}x{}@{}/{}:{}",
+                width, height, framerateNum, framerateDen, profile);
+    }
+};
+
+namespace
+{
+
+std::mutex SplashesMutex;
+std::map<std::string, std::weak_ptr<Splash>> Splashes;
+
+// profiles x264enc is able to produce from 8 bit 4:2:0 input
+const char* SupportedProfiles[] = {
+    "constrained-baseline",
+    "baseline",
+    "main",
+    "high",
+};
+
+}
+
+Splash::Params Splash::ParseParams(GstCaps* caps)
+{
+    Params params;
+    params.width = DefaultWidth;
+    params.height = DefaultHeight;
+    params.framerateNum = DefaultFramerate;
+    params.framerateDen = 1;
+    params.profile = "baseline";
+
+    const GstStructure* structure =
+        caps && !gst_caps_is_empty(caps) ?
+            gst_caps_get_structure(caps, 0) :
+            nullptr;
+    if(!structure)
+        return params;
+
+    gint width = 0;
+    gint height = 0;
+    if(gst_structure_get_int(structure, "width", &width) &&
+       gst_structure_get_int(structure, "height", &height) &&
+       width > 0 && height > 0)
+    {
+        params.width = width;
+        params.height = height;
+    }
+
+    // variable frame rate is signaled as 0/1
+    gint framerateNum = 0;
+    gint framerateDen = 0;
+    if(gst_structure_get_fraction(structure, "framerate", &framerateNum, &framerateDen) &&
+       framerateNum > 0 && framerateDen > 0)
+    {
+        params.framerateNum = framerateNum;
+        params.framerateDen = framerateDen;
+    }
+
+    if(const gchar* profile = gst_structure_get_string(structure, "profile")) {
+        params.profile = "high";
+        for(const char* supportedProfile: SupportedProfiles) {
+            if(0 == g_strcmp0(profile, supportedProfile)) {
+                params.profile = profile;
+                break;
+            }
+        }
+    }
+
+    return params;
+}
+
+std::shared_ptr<Splash> Splash::acquire(GstCaps* sourceCaps)
+{
+    const Params params = ParseParams(sourceCaps);
+    const std::string key = params.key();
+
+    std::lock_guard<std::mutex> lock(SplashesMutex);
+
+    for(auto it = Splashes.begin(); it != Splashes.end();) {
+        if(it->second.expired())
+            it = Splashes.erase(it);
+        else
+            ++it;
+    }
+
+    auto it = Splashes.find(key);
+    if(it != Splashes.end()) {
+        if(std::shared_ptr<Splash> splash = it->second.lock())
+            return splash;
+    }
+
+    std::shared_ptr<Splash> splash = Create(params);
+    if(splash) {
+        Log()->debug("Splash created. params: {}", key);
+        Splashes[key] = splash;
+    }
+
+    return splash;
+}
+
+std::shared_ptr<Splash> Splash::Create(const Params& params)
+{
+    // GOP of one second lets new listener join quickly
+    const gint keyframeInterval =
+        std::max(1, (params.framerateNum + params.framerateDen - 1) / params.framerateDen);
+
+    const std::string pipelineDesc =
+        fmt::format(
+            "videotestsrc pattern=blue is-live=true ! "
+            "video/x-raw,format=I420,width={},height={},framerate={}/{} ! "
+            "x264enc tune=zerolatency speed-preset=ultrafast bitrate={} key-int-max={} ! "
+            "video/x-h264,profile={} ! "
+            "h264parse config-interval=-1 ! "
+            "video/x-h264,stream-format=byte-stream,alignment=au ! "
+            "appsink name=channel sync=false",
+            params.width, params.height,
+            params.framerateNum, params.framerateDen,
+            static_cast<unsigned>(Bitrate), keyframeInterval,
+            params.profile);
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc.c_str(), &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->critical(
+            "Fail to create splash pipeline: {}",
+            errorPtr->message);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return nullptr;
+    }
+
+    std::shared_ptr<Channel> channel = std::make_shared<Channel>();
+
+    GstElementPtr appsinkPtr(gst_bin_get_by_name(GST_BIN(pipeline), "channel"));
+    Channel::attachAppSink(channel, appsinkPtr.get());
+
+    // the same time domain as media pipelines to keep timestamps as is
+    Private::UseSharedClock(GST_PIPELINE(pipeline));
+
+    std::shared_ptr<Splash> splash(new Splash(pipeline, channel));
+
+    if(GST_STATE_CHANGE_FAILURE == gst_element_set_state(pipeline, GST_STATE_PLAYING)) {
+        Log()->error("Fail to start splash pipeline");
+        return nullptr;
+    }
+
+    return splash;
+}
+
+Splash::Splash(GstElement* pipeline, const std::shared_ptr<Channel>& channel) :
+    _pipeline(pipeline), _channel(channel)
+{
+    // splash could be acquired from any thread,
+    // so errors are logged without main loop
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(
+        bus,
+        [] (GstBus*, GstMessage* message, gpointer) -> GstBusSyncReply {
+            if(GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+                GError* error = nullptr;
+                gst_message_parse_error(message, &error, nullptr);
+                GErrorPtr errorPtr(error);
+                Log()->error(
+                    "Splash. Pipeline error: {}",
+                    errorPtr ? errorPtr->message : "");
+            }
+            return GST_BUS_DROP;
+        },
+        nullptr, nullptr);
+    gst_object_unref(bus);
+}
+
+Splash::~Splash()
+{
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    gst_object_unref(_pipeline);
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// H.264 splash screen encoded with the same resolution, profile
+// and frame rate as source, so players could continue decoding
+// without reinit when media switches between source and splash.
+// Instances are shared by all medias with the same source caps
+// and live while used.
+class Splash
+{
+public:
+    enum {
+        DefaultWidth = 320,
+        DefaultHeight = 240,
+        DefaultFramerate = 25,
+        Bitrate = 256, // kbit/sec
+    };
+
+    // sourceCaps could be nullptr if source caps are not known yet,
+    // returns nullptr on failure
+    static std::shared_ptr<Splash> acquire(GstCaps* sourceCaps);
+    ~Splash();
+
+    const std::shared_ptr<Channel>& channel() const
+        { return _channel; }
+
+private:
+    struct Params;
+
+    static Params ParseParams(GstCaps*);
+    static std::shared_ptr<Splash> Create(const Params&);
+
+    Splash(GstElement* pipeline, const std::shared_ptr<Channel>&);
+
+private:
+    GstElement* _pipeline;
+
+    const std::shared_ptr<Channel> _channel;
+};
+
+}
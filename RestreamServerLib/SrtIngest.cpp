@@ -0,0 +1,424 @@
+#include "SrtIngest.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <future>
+
+#include <gst/app/gstappsink.h>
+
+#include <CxxPtr/GlibPtr.h>
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+const unsigned DefaultSrtLatency = 125; // ms, the same as SRT's default
+
+const std::string AccessControlPrefix = "#!::";
+
+const std::chrono::milliseconds AuthorizationPollInterval(50);
+
+}
+
+SrtIngest::SrtIngest(
+    const Callbacks& callbacks,
+    unsigned short port,
+    const std::string& defaultPath) :
+    _callbacks(callbacks),
+    _port(port),
+    _defaultPath(defaultPath),
+    _context(g_main_context_ref_thread_default()),
+    _pipeline(nullptr),
+    _busWatch(0),
+    _stopping(false),
+    _callerAccepted(false)
+{
+}
+
+SrtIngest::~SrtIngest()
+{
+    stopPipeline();
+
+    if(!_recordingPath.empty() && _callbacks.stopRecord)
+        _callbacks.stopRecord(_recordingPath);
+
+    g_main_context_unref(_context);
+}
+
+// https://github.com/Haivision/srt/blob/master/docs/features/access-control.md
+bool SrtIngest::ParseStreamId(
+    const std::string& streamId,
+    std::string* path,
+    std::string* user,
+    std::string* password)
+{
+    if(0 == streamId.compare(0, AccessControlPrefix.size(), AccessControlPrefix)) {
+        gchar** pairs = g_strsplit(streamId.c_str() + AccessControlPrefix.size(), ",", -1);
+        for(gchar** pair = pairs; *pair; ++pair) {
+            gchar* value = strchr(*pair, '=');
+            if(!value)
+                continue;
+
+            *value++ = '\0';
+            if(0 == g_strcmp0(*pair, "r"))
+                *path = value;
+            else if(0 == g_strcmp0(*pair, "u"))
+                *user = value;
+            else if(0 == g_strcmp0(*pair, "p"))
+                *password = value;
+        }
+        g_strfreev(pairs);
+    } else
+        *path = streamId;
+
+    if(path->empty())
+        return false;
+
+    if((*path)[0] != '/')
+        path->insert(0, "/");
+
+    return true;
+}
+
+bool SrtIngest::start()
+{
+    return startPipeline();
+}
+
+bool SrtIngest::startPipeline()
+{
+    const unsigned latency =
+        _callbacks.latency && !_defaultPath.empty() ?
+            _callbacks.latency(_defaultPath) :
+            DefaultSrtLatency;
+
+    const std::string pipelineDesc =
+        fmt::format(
+            "srtsrc name=srt uri=srt://:{}?mode=listener latency={} ! "
+            "tsdemux ! h264parse config-interval=-1 ! "
+            "video/x-h264,stream-format=byte-stream,alignment=au ! "
+            "appsink name=channel sync=false async=false",
+            _port, latency);
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc.c_str(), &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->critical(
+            "Fail to create SRT ingest pipeline: {}",
+            errorPtr->message);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return false;
+    }
+
+    _pipeline = pipeline;
+
+    GstElementPtr srtsrcPtr(gst_bin_get_by_name(GST_BIN(pipeline), "srt"));
+    GstElement* srtsrc = srtsrcPtr.get();
+
+#if GST_CHECK_VERSION(1, 22, 0)
+    g_signal_connect(srtsrc, "caller-connecting",
+        G_CALLBACK(
+            (gboolean (*)(GstElement*, GSocketAddress*, const gchar*, gpointer))
+            [] (GstElement*, GSocketAddress*, const gchar* streamId, gpointer userData) -> gboolean {
+                SrtIngest* self = static_cast<SrtIngest*>(userData);
+                return self->callerConnecting(streamId ? streamId : "");
+            }),
+        this);
+#endif
+    g_signal_connect(srtsrc, "caller-added",
+        G_CALLBACK(
+            (void (*)(GstElement*, gint, GSocketAddress*, gpointer))
+            [] (GstElement*, gint, GSocketAddress*, gpointer userData) {
+                SrtIngest* self = static_cast<SrtIngest*>(userData);
+#if !GST_CHECK_VERSION(1, 22, 0)
+                if(!self->callerConnecting(std::string()))
+                    return;
+#endif
+                self->invoke(&SrtIngest::callerAdded);
+            }),
+        this);
+    g_signal_connect(srtsrc, "caller-removed",
+        G_CALLBACK(
+            (void (*)(GstElement*, gint, GSocketAddress*, gpointer))
+            [] (GstElement*, gint, GSocketAddress*, gpointer userData) {
+                SrtIngest* self = static_cast<SrtIngest*>(userData);
+                self->invoke(&SrtIngest::callerRemoved);
+            }),
+        this);
+
+    GstElementPtr appsinkPtr(gst_bin_get_by_name(GST_BIN(pipeline), "channel"));
+    GstAppSinkCallbacks appsinkCallbacks = {};
+    appsinkCallbacks.new_sample =
+        [] (GstAppSink* appsink, gpointer userData) -> GstFlowReturn {
+            SrtIngest* self = static_cast<SrtIngest*>(userData);
+            if(GstSample* sample = gst_app_sink_pull_sample(appsink))
+                self->push(sample);
+            return GST_FLOW_OK;
+        };
+    gst_app_sink_set_callbacks(
+        GST_APP_SINK(appsinkPtr.get()), &appsinkCallbacks, this, nullptr);
+
+    // the same time domain as media pipelines to keep timestamps as is
+    Private::UseSharedClock(GST_PIPELINE(pipeline));
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    _busWatch =
+        gst_bus_add_watch(
+            bus,
+            [] (GstBus*, GstMessage* message, gpointer userData) -> gboolean {
+                SrtIngest* self = static_cast<SrtIngest*>(userData);
+                switch(GST_MESSAGE_TYPE(message)) {
+                case GST_MESSAGE_ERROR: {
+                    GError* error = nullptr;
+                    gst_message_parse_error(message, &error, nullptr);
+                    GErrorPtr errorPtr(error);
+                    Log()->error(
+                        "SrtIngest. Pipeline error: {}",
+                        errorPtr ? errorPtr->message : "");
+                    self->invoke(&SrtIngest::restart);
+                    break;
+                }
+                case GST_MESSAGE_EOS:
+                    self->invoke(&SrtIngest::restart);
+                    break;
+                default:
+                    break;
+                }
+                return G_SOURCE_CONTINUE;
+            },
+            this);
+    gst_object_unref(bus);
+
+    if(GST_STATE_CHANGE_FAILURE == gst_element_set_state(pipeline, GST_STATE_PLAYING)) {
+        Log()->error("SrtIngest. Fail to listen on port {}", _port);
+        stopPipeline();
+        return false;
+    }
+
+    Log()->info("SrtIngest. Listening on port {}", _port);
+
+    return true;
+}
+
+void SrtIngest::stopPipeline()
+{
+    if(!_pipeline)
+        return;
+
+    if(_busWatch) {
+        g_source_remove(_busWatch);
+        _busWatch = 0;
+    }
+
+    _stopping = true;
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    _stopping = false;
+    gst_object_unref(_pipeline);
+    _pipeline = nullptr;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _callerAccepted = false;
+    _channel.reset();
+}
+
+// drops current publisher if any and waits for the next one
+void SrtIngest::restart()
+{
+    stopPipeline();
+
+    if(!_recordingPath.empty()) {
+        if(_callbacks.stopRecord)
+            _callbacks.stopRecord(_recordingPath);
+        _recordingPath.clear();
+    }
+
+    startPipeline();
+}
+
+void SrtIngest::invoke(void (SrtIngest::*method)())
+{
+    struct Invocation
+    {
+        std::weak_ptr<SrtIngest> self;
+        void (SrtIngest::*method)();
+    };
+
+    g_main_context_invoke_full(
+        _context,
+        G_PRIORITY_DEFAULT,
+        [] (gpointer userData) -> gboolean {
+            Invocation* invocation = static_cast<Invocation*>(userData);
+            if(std::shared_ptr<SrtIngest> self = invocation->self.lock())
+                ((*self).*(invocation->method))();
+            return G_SOURCE_REMOVE;
+        },
+        new Invocation { shared_from_this(), method },
+        [] (gpointer userData) {
+            delete static_cast<Invocation*>(userData);
+        });
+}
+
+// application callbacks are not expected to be called from other threads,
+// so authorization is done on main context
+bool SrtIngest::authorize(
+    const std::string& user,
+    const std::string& password,
+    const std::string& path)
+{
+    if(!_callbacks.authorize)
+        return true;
+
+    // invocation could outlive SrtIngest if waiting was interrupted
+    struct Invocation
+    {
+        std::function<bool (
+            const std::string& user,
+            const std::string& password,
+            const std::string& path)> authorize;
+        std::string user;
+        std::string password;
+        std::string path;
+        std::shared_ptr<std::atomic<bool> > cancelled;
+        std::promise<bool> authorized;
+    };
+
+    std::shared_ptr<std::atomic<bool> > cancelled =
+        std::make_shared<std::atomic<bool> >(false);
+
+    Invocation* invocation =
+        new Invocation {
+            _callbacks.authorize, user, password, path, cancelled, std::promise<bool>() };
+    std::future<bool> authorized = invocation->authorized.get_future();
+
+    g_main_context_invoke_full(
+        _context,
+        G_PRIORITY_DEFAULT,
+        [] (gpointer userData) -> gboolean {
+            Invocation* invocation = static_cast<Invocation*>(userData);
+            invocation->authorized.set_value(
+                !invocation->cancelled->load() &&
+                invocation->authorize(invocation->user, invocation->password, invocation->path));
+            return G_SOURCE_REMOVE;
+        },
+        invocation,
+        [] (gpointer userData) {
+            delete static_cast<Invocation*>(userData);
+        });
+
+    while(std::future_status::ready != authorized.wait_for(AuthorizationPollInterval)) {
+        if(_stopping) {
+            cancelled->store(true);
+            return false;
+        }
+    }
+
+    try {
+        return authorized.get();
+    } catch(const std::future_error&) {
+        // context is gone
+        return false;
+    }
+}
+
+bool SrtIngest::callerConnecting(const std::string& streamId)
+{
+    std::string path;
+    std::string user;
+    std::string password;
+    if(streamId.empty())
+        path = _defaultPath;
+    else if(!ParseStreamId(streamId, &path, &user, &password)) {
+        Log()->info("SrtIngest. Invalid stream id: {}", streamId);
+        return false;
+    }
+
+    if(path.empty())
+        return false;
+
+    if(!authorize(user, password, path)) {
+        Log()->info(
+            "SrtIngest. Publisher unauthorized. user: {}, path: {}",
+            user, path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if(_callerAccepted) {
+        Log()->info("SrtIngest. Port {} is busy", _port);
+        return false;
+    }
+
+    _callerAccepted = true;
+    _pendingPath = path;
+    _pendingUser = user;
+
+    return true;
+}
+
+void SrtIngest::callerAdded()
+{
+    std::string path;
+    std::string user;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        path = _pendingPath;
+        user = _pendingUser;
+    }
+
+    if(path.empty() || !_recordingPath.empty())
+        return;
+
+    std::shared_ptr<Channel> channel =
+        _callbacks.startRecord ? _callbacks.startRecord(user, path) : nullptr;
+    if(!channel) {
+        Log()->info("SrtIngest. Recording rejected. path: {}", path);
+        restart();
+        return;
+    }
+
+    Log()->info("SrtIngest. Publisher connected. user: {}, path: {}", user, path);
+
+    _recordingPath = path;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _channel = channel;
+}
+
+void SrtIngest::callerRemoved()
+{
+    // already handled or it's from previous pipeline instance
+    if(_recordingPath.empty())
+        return;
+
+    Log()->info("SrtIngest. Publisher disconnected. path: {}", _recordingPath);
+
+    // tsdemux and parser have to be reset for the next publisher anyway
+    restart();
+}
+
+void SrtIngest::push(GstSample* sample)
+{
+    std::shared_ptr<Channel> channel;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        channel = _channel;
+    }
+
+    if(channel)
+        channel->push(sample);
+    else
+        gst_sample_unref(sample);
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// Accepts SRT publisher on port and pushes it's stream
+// (MPEG-TS with H.264) to the channel of the path.
+// Path, user and password are taken from SRT stream id
+// ("#!::r=/path,u=user,p=password" or just path),
+// with GStreamer older than 1.22 stream id isn't available
+// and default path is used.
+// Only one publisher per port is served at a time.
+class SrtIngest : public std::enable_shared_from_this<SrtIngest>
+{
+public:
+    struct Callbacks
+    {
+        // called from main context while SRT thread waits for result
+        std::function<bool (
+            const std::string& user,
+            const std::string& password,
+            const std::string& path)> authorize;
+        // called from main context, returns nullptr if recording is not allowed
+        std::function<std::shared_ptr<Channel> (
+            const std::string& user,
+            const std::string& path)> startRecord;
+        std::function<void (const std::string& path)> stopRecord;
+        // SRT latency in milliseconds
+        std::function<unsigned (const std::string& path)> latency;
+    };
+
+    SrtIngest(
+        const Callbacks&,
+        unsigned short port,
+        const std::string& defaultPath);
+    ~SrtIngest();
+
+    bool start();
+
+private:
+    static bool ParseStreamId(
+        const std::string& streamId,
+        std::string* path,
+        std::string* user,
+        std::string* password);
+
+    void invoke(void (SrtIngest::*)());
+
+    // called from SRT thread
+    bool authorize(
+        const std::string& user,
+        const std::string& password,
+        const std::string& path);
+    bool callerConnecting(const std::string& streamId);
+    void callerAdded();
+    void callerRemoved();
+    void push(GstSample*);
+
+    bool startPipeline();
+    void stopPipeline();
+    void restart();
+
+private:
+    const Callbacks _callbacks;
+    const unsigned short _port;
+    const std::string _defaultPath;
+
+    GMainContext* _context;
+
+    GstElement* _pipeline;
+    guint _busWatch;
+
+    // SRT thread shouldn't wait for main context
+    // while main context waits for SRT thread
+    std::atomic<bool> _stopping;
+
+    std::mutex _mutex;
+    bool _callerAccepted;
+    std::string _pendingPath;
+    std::string _pendingUser;
+    std::shared_ptr<Channel> _channel;
+
+    // accessed from main context only
+    std::string _recordingPath;
+};
+
+}
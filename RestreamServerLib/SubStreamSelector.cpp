@@ -0,0 +1,115 @@
+#include "SubStreamSelector.h"
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+std::unique_ptr<SubStreamSelector> SubStreamSelector::create(
+    const std::shared_ptr<Channel>& main,
+    const std::shared_ptr<Channel>& sub)
+{
+    std::unique_ptr<SubStreamSelector> selector(new SubStreamSelector(main, sub));
+
+    selector->_mainListenerId =
+        main->addListener(std::bind(&SubStreamSelector::drain, selector.get()));
+    if(selector->_mainListenerId == Channel::InvalidListener)
+        return nullptr;
+
+    selector->_subListenerId =
+        sub->addListener(std::bind(&SubStreamSelector::drain, selector.get()));
+    if(selector->_subListenerId == Channel::InvalidListener)
+        return nullptr;
+
+    selector->drain();
+
+    return selector;
+}
+
+SubStreamSelector::SubStreamSelector(
+    const std::shared_ptr<Channel>& main,
+    const std::shared_ptr<Channel>& sub) :
+    _main(main), _sub(sub), _output(std::make_shared<Channel>()),
+    _mainListenerId(Channel::InvalidListener),
+    _subListenerId(Channel::InvalidListener),
+    _drainRequests(0),
+    _subSelected(false), _waitKeyframe(false), _lastSubTime(0)
+{
+}
+
+SubStreamSelector::~SubStreamSelector()
+{
+    if(_subListenerId != Channel::InvalidListener)
+        _sub->removeListener(_subListenerId);
+    if(_mainListenerId != Channel::InvalidListener)
+        _main->removeListener(_mainListenerId);
+}
+
+bool SubStreamSelector::IsKeyframe(GstSample* sample)
+{
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+
+    return buffer && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+void SubStreamSelector::drain()
+{
+    Private::CombineDrains(
+        &_drainRequests,
+        [this] () {
+            while(GstSample* sample = _sub->pull(_subListenerId))
+                forwardSub(sample);
+            while(GstSample* sample = _main->pull(_mainListenerId))
+                forwardMain(sample);
+        });
+}
+
+void SubStreamSelector::forwardSub(GstSample* sample)
+{
+    _lastSubTime = g_get_monotonic_time();
+
+    if(!_subSelected) {
+        if(!IsKeyframe(sample)) {
+            _sub->requestKeyframe();
+            gst_sample_unref(sample);
+            return;
+        }
+
+        Log()->debug("SubStreamSelector. Switching to sub stream.");
+        _subSelected = true;
+        _waitKeyframe = false;
+    }
+
+    _output->push(sample);
+}
+
+void SubStreamSelector::forwardMain(GstSample* sample)
+{
+    if(_subSelected) {
+        const gint64 subTimeout = gint64(SubTimeout) * 1000;
+        if(g_get_monotonic_time() - _lastSubTime <= subTimeout) {
+            gst_sample_unref(sample);
+            return;
+        }
+
+        Log()->debug("SubStreamSelector. Sub stream lost. Switching to main stream.");
+        _subSelected = false;
+        _waitKeyframe = true;
+    }
+
+    if(_waitKeyframe) {
+        if(!IsKeyframe(sample)) {
+            _main->requestKeyframe();
+            gst_sample_unref(sample);
+            return;
+        }
+
+        _waitKeyframe = false;
+    }
+
+    _output->push(sample);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <gst/gst.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// Republishes sub (low resolution) stream of path to own channel
+// while it's published and main stream otherwise,
+// so preview consumers get the smallest stream available without transcoding.
+// Streams are switched on keyframe of stream switched to only.
+class SubStreamSelector
+{
+public:
+    enum {
+        SubTimeout = 2000, // ms without sub stream samples to fall back to main
+    };
+
+    static std::unique_ptr<SubStreamSelector> create(
+        const std::shared_ptr<Channel>& main,
+        const std::shared_ptr<Channel>& sub);
+    ~SubStreamSelector();
+
+    const std::shared_ptr<Channel>& output() const
+        { return _output; }
+
+private:
+    SubStreamSelector(
+        const std::shared_ptr<Channel>& main,
+        const std::shared_ptr<Channel>& sub);
+
+    static bool IsKeyframe(GstSample*);
+
+    void drain();
+    void forwardMain(GstSample*);
+    void forwardSub(GstSample*);
+
+private:
+    const std::shared_ptr<Channel> _main;
+    const std::shared_ptr<Channel> _sub;
+    const std::shared_ptr<Channel> _output;
+
+    Channel::ListenerId _mainListenerId;
+    Channel::ListenerId _subListenerId;
+    std::atomic<unsigned> _drainRequests;
+
+    // accessed from draining thread only
+    bool _subSelected;
+    bool _waitKeyframe;
+    gint64 _lastSubTime; // monotonic, us
+};
+
+}
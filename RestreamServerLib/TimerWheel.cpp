@@ -0,0 +1,115 @@
+#include "TimerWheel.h"
+
+#include <cassert>
+
+
+namespace RestreamServerLib
+{
+
+TimerWheel::TimerWheel(uint64_t tick, uint64_t now) :
+    _tick(tick), _current(now / tick)
+{
+    assert(tick > 0);
+}
+
+void TimerWheel::insert(Key key, Timer* timer, uint64_t earliest)
+{
+    uint64_t deadline = timer->deadline;
+    if(deadline < earliest)
+        deadline = earliest;
+
+    const uint64_t delta = deadline - _current;
+
+    unsigned level = 0;
+    while(level < LEVELS - 1 &&
+          delta >= (uint64_t(1) << ((level + 1) * LEVEL_BITS)))
+    {
+        ++level;
+    }
+
+    const uint64_t maxDeadline =
+        _current + (uint64_t(1) << (LEVELS * LEVEL_BITS)) - 1;
+    if(deadline > maxDeadline)
+        deadline = maxDeadline; // will be rescheduled on cascade
+
+    timer->level = level;
+    timer->slot = (deadline >> (level * LEVEL_BITS)) & (LEVEL_SLOTS - 1);
+
+    Slot& slot = _slots[timer->level][timer->slot];
+    timer->position = slot.insert(slot.end(), key);
+}
+
+void TimerWheel::schedule(Key key, uint64_t deadline)
+{
+    auto it = _timers.find(key);
+    if(it == _timers.end())
+        it = _timers.emplace(key, Timer()).first;
+    else
+        _slots[it->second.level][it->second.slot].erase(it->second.position);
+
+    Timer& timer = it->second;
+    timer.deadline = (deadline + _tick - 1) / _tick;
+
+    // current slot is already processed
+    insert(key, &timer, _current + 1);
+}
+
+void TimerWheel::cancel(Key key)
+{
+    auto it = _timers.find(key);
+    if(it == _timers.end())
+        return;
+
+    _slots[it->second.level][it->second.slot].erase(it->second.position);
+    _timers.erase(it);
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    const unsigned index =
+        (_current >> (level * LEVEL_BITS)) & (LEVEL_SLOTS - 1);
+
+    Slot slot;
+    slot.swap(_slots[level][index]);
+
+    // current slot of level 0 is processed right after cascade
+    for(Key key: slot)
+        insert(key, &_timers[key], _current);
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<Key>* expired)
+{
+    const uint64_t target = now / _tick;
+
+    while(_current < target && !_timers.empty()) {
+        ++_current;
+
+        // move timers from upper levels down when lower level wraps
+        for(unsigned level = 1; level < LEVELS; ++level) {
+            if(_current & ((uint64_t(1) << (level * LEVEL_BITS)) - 1))
+                break;
+
+            cascade(level);
+        }
+
+        Slot& slot = _slots[0][_current & (LEVEL_SLOTS - 1)];
+        for(auto it = slot.begin(); it != slot.end();) {
+            auto timerIt = _timers.find(*it);
+            if(timerIt->second.deadline > _current) {
+                // was clamped by wheel range
+                Key key = *it;
+                it = slot.erase(it);
+                insert(key, &timerIt->second, _current + 1);
+            } else {
+                expired->push_back(*it);
+                _timers.erase(timerIt);
+                it = slot.erase(it);
+            }
+        }
+    }
+
+    if(_current < target)
+        _current = target;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+
+namespace RestreamServerLib
+{
+
+// Hierarchical timer wheel.
+// Adding, refreshing and removing timer are O(1),
+// advance processes only timers which are actually due.
+class TimerWheel
+{
+public:
+    typedef const void* Key;
+
+    // tick - time resolution in ms
+    TimerWheel(uint64_t tick, uint64_t now);
+
+    // deadline - absolute time in ms,
+    // rearms timer if it's already scheduled
+    void schedule(Key, uint64_t deadline);
+    void cancel(Key);
+
+    bool empty() const
+        { return _timers.empty(); }
+
+    // moves wheel to specified time and appends due timers to expired
+    void advance(uint64_t now, std::vector<Key>* expired);
+
+private:
+    enum {
+        LEVEL_BITS = 6,
+        LEVEL_SLOTS = 1 << LEVEL_BITS,
+        LEVELS = 4,
+    };
+
+    struct Timer;
+    typedef std::list<Key> Slot;
+
+    struct Timer
+    {
+        uint64_t deadline; // in ticks
+        unsigned level;
+        unsigned slot;
+        Slot::iterator position;
+    };
+
+    void insert(Key, Timer*, uint64_t earliest);
+    void cascade(unsigned level);
+
+private:
+    const uint64_t _tick;
+    uint64_t _current; // in ticks
+
+    Slot _slots[LEVELS][LEVEL_SLOTS];
+    std::unordered_map<Key, Timer> _timers;
+};
+
+}
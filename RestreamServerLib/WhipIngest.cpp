@@ -0,0 +1,877 @@
+#include "WhipIngest.h"
+
+#if HAVE_GST_WEBRTC
+
+#include <stdio.h>
+
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <vector>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+#include <gst/sdp/sdp.h>
+
+#include <CxxPtr/GlibPtr.h>
+#include <CxxPtr/GstPtr.h>
+
+#include "Log.h"
+#include "Private.h"
+
+
+namespace RestreamServerLib
+{
+
+namespace
+{
+
+const std::string ResourceQuery = "resource=";
+
+// the first H.264 payload type of the first video media of offer or -1
+int H264PayloadType(const GstSDPMessage* sdp)
+{
+    for(guint i = 0; i < gst_sdp_message_medias_len(sdp); ++i) {
+        const GstSDPMedia* media = gst_sdp_message_get_media(sdp, i);
+        if(0 != g_strcmp0(gst_sdp_media_get_media(media), "video"))
+            continue;
+
+        for(guint j = 0; j < gst_sdp_media_attributes_len(media); ++j) {
+            const GstSDPAttribute* attribute = gst_sdp_media_get_attribute(media, j);
+            if(0 != g_strcmp0(attribute->key, "rtpmap") || !attribute->value)
+                continue;
+
+            int payloadType;
+            char encoding[32];
+            if(2 == sscanf(attribute->value, "%d %31[^/]", &payloadType, encoding) &&
+               0 == g_ascii_strcasecmp(encoding, "H264"))
+            {
+                return payloadType;
+            }
+        }
+    }
+
+    return -1;
+}
+
+// resource id is the only thing identifying session in DELETE besides credentials,
+// so it's taken from kernel's CSPRNG
+bool RandomId(std::string* id)
+{
+    enum { IdSize = 16 };
+
+    FILE* urandom = fopen("/dev/urandom", "rb");
+    if(!urandom)
+        return false;
+
+    unsigned char bytes[IdSize];
+    const bool read = IdSize == fread(bytes, 1, IdSize, urandom);
+    fclose(urandom);
+    if(!read)
+        return false;
+
+    id->clear();
+    for(unsigned char byte: bytes)
+        *id += fmt::format("{:02x}", byte);
+
+    return true;
+}
+
+// true if promise was replied without error
+bool WaitPromise(GstPromise* promise)
+{
+    const bool replied = GST_PROMISE_RESULT_REPLIED == gst_promise_wait(promise);
+    const GstStructure* reply = replied ? gst_promise_get_reply(promise) : nullptr;
+
+    GError* error = nullptr;
+    if(reply && gst_structure_has_field(reply, "error"))
+        gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL);
+    GErrorPtr errorPtr(error);
+    if(errorPtr)
+        Log()->error("WhipIngest. WebRTC negotiation error: {}", errorPtr->message);
+
+    return replied && !errorPtr;
+}
+
+}
+
+struct WhipIngest::Request
+{
+    std::string method;
+    std::string path;
+    std::string query;
+    std::map<std::string, std::string> headers; // lower case names
+    std::string body;
+
+    std::string header(const std::string& name) const
+    {
+        auto it = headers.find(name);
+        return it != headers.end() ? it->second : std::string();
+    }
+};
+
+struct WhipIngest::Response
+{
+    Response(unsigned status, const char* reason) :
+        status(status), reason(reason) {}
+
+    unsigned status;
+    std::string reason;
+    std::vector<std::pair<std::string, std::string> > headers;
+    std::string body;
+};
+
+struct WhipIngest::Session
+{
+    Session(
+        const std::weak_ptr<WhipIngest>& owner,
+        const std::string& id,
+        const std::string& user,
+        const std::string& path) :
+        owner(owner), id(id), user(user), path(path),
+        pipeline(nullptr), webrtc(nullptr),
+        iceGatheredFuture(iceGathered.get_future()) {}
+    ~Session()
+    {
+        if(!pipeline)
+            return;
+
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(webrtc);
+        gst_object_unref(pipeline);
+    }
+
+    // called from any thread
+    void stop()
+    {
+        if(std::shared_ptr<WhipIngest> owner = this->owner.lock()) {
+            const std::string id = this->id;
+            owner->invoke(
+                [owner, id] () {
+                    owner->stopSession(id);
+                });
+        }
+    }
+
+    const std::weak_ptr<WhipIngest> owner;
+    const std::string id;
+    const std::string user;
+    const std::string path;
+
+    GstElement* pipeline;
+    GstElement* webrtc;
+
+    std::once_flag iceGatheredFlag;
+    std::promise<void> iceGathered;
+    std::future<void> iceGatheredFuture;
+};
+
+WhipIngest::WhipIngest(
+    const Callbacks& callbacks,
+    unsigned short port) :
+    _callbacks(callbacks),
+    _port(port),
+    _context(g_main_context_ref_thread_default()),
+    _service(nullptr)
+{
+}
+
+WhipIngest::~WhipIngest()
+{
+    if(_service) {
+        g_socket_service_stop(_service);
+        g_socket_listener_close(G_SOCKET_LISTENER(_service));
+        g_object_unref(_service);
+    }
+
+    std::map<std::string, std::shared_ptr<Session> > sessions;
+    {
+        std::lock_guard<std::mutex> lock(_sessionsMutex);
+        sessions.swap(_sessions);
+    }
+
+    for(const auto& pair: sessions) {
+        if(_callbacks.stopRecord)
+            _callbacks.stopRecord(pair.second->path);
+    }
+    sessions.clear();
+
+    g_main_context_unref(_context);
+}
+
+bool WhipIngest::start()
+{
+    _service = g_threaded_socket_service_new(MaxConnections);
+
+    GError* error = nullptr;
+    g_socket_listener_add_inet_port(
+        G_SOCKET_LISTENER(_service), _port, nullptr, &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->error(
+            "WhipIngest. Fail to listen on port {}: {}",
+            _port, errorPtr->message);
+        return false;
+    }
+
+    g_signal_connect_data(_service, "run",
+        G_CALLBACK(
+            (gboolean (*)(GThreadedSocketService*, GSocketConnection*, GObject*, gpointer))
+            [] (GThreadedSocketService*, GSocketConnection* connection, GObject*, gpointer userData) -> gboolean {
+                std::weak_ptr<WhipIngest>* weakSelf =
+                    static_cast<std::weak_ptr<WhipIngest>*>(userData);
+                if(std::shared_ptr<WhipIngest> self = weakSelf->lock())
+                    self->handleConnection(connection);
+                return TRUE;
+            }),
+        new std::weak_ptr<WhipIngest>(shared_from_this()),
+        [] (gpointer userData, GClosure*) {
+            delete static_cast<std::weak_ptr<WhipIngest>*>(userData);
+        },
+        GConnectFlags(0));
+
+    g_socket_service_start(_service);
+
+    Log()->info("WhipIngest. Listening on port {}", _port);
+
+    return true;
+}
+
+// request is read in bounded chunks, so neither a line without CRLF
+// nor anything else could make it grow beyond MaxRequestSize
+bool WhipIngest::ReadRequest(GInputStream* inputStream, Request* request)
+{
+    enum { ChunkSize = 4096 };
+
+    // read but not parsed yet
+    std::string buffered;
+    gsize totalRead = 0;
+
+    auto readChunk =
+        [inputStream, &buffered, &totalRead] () -> bool {
+            if(totalRead >= MaxRequestSize)
+                return false;
+
+            char chunk[ChunkSize];
+            const gssize size =
+                g_input_stream_read(
+                    inputStream,
+                    chunk, std::min<gsize>(sizeof(chunk), MaxRequestSize - totalRead),
+                    nullptr, nullptr);
+            if(size <= 0)
+                return false;
+
+            buffered.append(chunk, size);
+            totalRead += size;
+
+            return true;
+        };
+
+    auto readLine =
+        [&buffered, &readChunk] (std::string* line) -> bool {
+            std::string::size_type lineEnd;
+            while(std::string::npos == (lineEnd = buffered.find("\r\n"))) {
+                if(!readChunk())
+                    return false;
+            }
+
+            line->assign(buffered, 0, lineEnd);
+            buffered.erase(0, lineEnd + 2);
+
+            return true;
+        };
+
+    std::string line;
+    if(!readLine(&line))
+        return false;
+
+    // METHOD target HTTP/1.x
+    const std::string::size_type methodEnd = line.find(' ');
+    const std::string::size_type targetEnd = line.rfind(' ');
+    if(methodEnd == std::string::npos || targetEnd == methodEnd)
+        return false;
+
+    request->method = line.substr(0, methodEnd);
+
+    const std::string target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    const std::string::size_type queryStart = target.find('?');
+    GCharPtr pathPtr(g_uri_unescape_string(target.substr(0, queryStart).c_str(), nullptr));
+    if(!pathPtr)
+        return false;
+    request->path = pathPtr.get();
+    if(queryStart != std::string::npos)
+        request->query = target.substr(queryStart + 1);
+
+    while(readLine(&line) && !line.empty()) {
+        const std::string::size_type nameEnd = line.find(':');
+        if(nameEnd == std::string::npos)
+            return false;
+
+        GCharPtr namePtr(g_ascii_strdown(line.c_str(), nameEnd));
+        const std::string::size_type valueStart =
+            line.find_first_not_of(' ', nameEnd + 1);
+        request->headers[namePtr.get()] =
+            valueStart != std::string::npos ? line.substr(valueStart) : std::string();
+    }
+    // connection was closed or size limit reached before headers end
+    if(!line.empty())
+        return false;
+
+    const std::string contentLength = request->header("content-length");
+    const guint64 bodySize = g_ascii_strtoull(contentLength.c_str(), nullptr, 10);
+    const gsize headersSize = totalRead - buffered.size();
+    if(bodySize > MaxRequestSize - headersSize)
+        return false;
+
+    request->body = buffered.substr(0, bodySize);
+    if(request->body.size() < bodySize) {
+        const gsize bufferedSize = request->body.size();
+        request->body.resize(bodySize);
+        gsize bytesRead = 0;
+        if(!g_input_stream_read_all(
+                inputStream,
+                &request->body[bufferedSize], bodySize - bufferedSize, &bytesRead,
+                nullptr, nullptr) ||
+           bytesRead != bodySize - bufferedSize)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void WhipIngest::WriteResponse(GOutputStream* outputStream, const Response& response)
+{
+    std::string data =
+        fmt::format("HTTP/1.1 {} {}\r\n", response.status, response.reason);
+    for(const auto& header: response.headers)
+        data += header.first + ": " + header.second + "\r\n";
+    // browser publishers are served from other origins
+    data +=
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Methods: POST, DELETE, OPTIONS\r\n"
+        "Access-Control-Allow-Headers: Authorization, Content-Type\r\n"
+        "Access-Control-Expose-Headers: Location\r\n";
+    data += fmt::format("Content-Length: {}\r\n", response.body.size());
+    data += "Connection: close\r\n\r\n";
+    data += response.body;
+
+    g_output_stream_write_all(
+        outputStream, data.data(), data.size(), nullptr, nullptr, nullptr);
+}
+
+void WhipIngest::ParseCredentials(
+    const std::string& authorization,
+    std::string* user,
+    std::string* password)
+{
+    const std::string basicPrefix = "Basic ";
+    const std::string bearerPrefix = "Bearer ";
+
+    std::string credentials;
+    if(0 == g_ascii_strncasecmp(authorization.c_str(), basicPrefix.c_str(), basicPrefix.size())) {
+        gsize length = 0;
+        guchar* decoded = g_base64_decode(authorization.c_str() + basicPrefix.size(), &length);
+        credentials.assign(reinterpret_cast<const char*>(decoded), length);
+        g_free(decoded);
+    } else if(0 == g_ascii_strncasecmp(authorization.c_str(), bearerPrefix.c_str(), bearerPrefix.size()))
+        credentials = authorization.substr(bearerPrefix.size());
+    else
+        return;
+
+    const std::string::size_type separator = credentials.find(':');
+    if(separator == std::string::npos) {
+        *password = credentials;
+        return;
+    }
+
+    *user = credentials.substr(0, separator);
+    *password = credentials.substr(separator + 1);
+}
+
+void WhipIngest::handleConnection(GSocketConnection* connection)
+{
+    g_socket_set_timeout(g_socket_connection_get_socket(connection), RequestTimeout);
+
+    Request request;
+    Response response(400, "Bad Request");
+    if(ReadRequest(g_io_stream_get_input_stream(G_IO_STREAM(connection)), &request)) {
+        if(request.method == "OPTIONS")
+            response = Response(204, "No Content");
+        else if(request.method == "POST")
+            response = post(request);
+        else if(request.method == "DELETE")
+            response = remove(request);
+        else
+            response = Response(405, "Method Not Allowed");
+    }
+
+    WriteResponse(g_io_stream_get_output_stream(G_IO_STREAM(connection)), response);
+}
+
+// application callbacks are not expected to be called from other threads
+bool WhipIngest::authorize(
+    const std::string& user,
+    const std::string& password,
+    const std::string& path)
+{
+    bool authorized = !_callbacks.authorize;
+    invokeSync(
+        [this, &authorized, &user, &password, &path] () {
+            if(_callbacks.authorize)
+                authorized = _callbacks.authorize(user, password, path);
+        });
+
+    return authorized;
+}
+
+WhipIngest::Response WhipIngest::post(const Request& request)
+{
+    const std::string& path = request.path;
+    if(path.size() < 2 || path[0] != '/')
+        return Response(404, "Not Found");
+
+    if(0 != request.header("content-type").compare(0, 15, "application/sdp"))
+        return Response(415, "Unsupported Media Type");
+
+    GstSDPMessage* sdp = nullptr;
+    gst_sdp_message_new(&sdp);
+    const bool offerValid =
+        GST_SDP_OK == gst_sdp_message_parse_buffer(
+            reinterpret_cast<const guint8*>(request.body.data()), request.body.size(), sdp);
+    const int payloadType = offerValid ? H264PayloadType(sdp) : -1;
+    gst_sdp_message_free(sdp);
+    if(!offerValid)
+        return Response(400, "Bad Request");
+
+    std::string user;
+    std::string password;
+    ParseCredentials(request.header("authorization"), &user, &password);
+
+    if(!authorize(user, password, path)) {
+        Log()->info(
+            "WhipIngest. Publisher unauthorized. user: {}, path: {}",
+            user, path);
+        Response response(401, "Unauthorized");
+        response.headers.emplace_back("WWW-Authenticate", "Basic realm=\"WHIP\"");
+        return response;
+    }
+
+    if(payloadType < 0) {
+        Log()->info("WhipIngest. Offer without H.264. path: {}", path);
+        return Response(406, "Not Acceptable");
+    }
+
+    std::shared_ptr<Channel> channel;
+    invokeSync(
+        [this, &channel, &user, &path] () {
+            if(_callbacks.startRecord)
+                channel = _callbacks.startRecord(user, path);
+        });
+    if(!channel) {
+        Log()->info("WhipIngest. Recording rejected. path: {}", path);
+        return Response(403, "Forbidden");
+    }
+
+    std::shared_ptr<Session> session = createSession(user, path, payloadType, channel);
+    if(!session) {
+        invokeSync(
+            [this, &path] () {
+                if(_callbacks.stopRecord)
+                    _callbacks.stopRecord(path);
+            });
+        return Response(500, "Internal Server Error");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_sessionsMutex);
+        _sessions.emplace(session->id, session);
+    }
+
+    std::string answer;
+    if(!Negotiate(session.get(), request.body, &answer)) {
+        const std::string& id = session->id;
+        invokeSync(
+            [this, &id] () {
+                stopSession(id);
+            });
+        return Response(500, "Internal Server Error");
+    }
+
+    Log()->info("WhipIngest. Publisher connected. user: {}, path: {}", user, path);
+
+    Response response(201, "Created");
+    response.headers.emplace_back("Content-Type", "application/sdp");
+    response.headers.emplace_back("Location", path + "?" + ResourceQuery + session->id);
+    response.body = answer;
+
+    return response;
+}
+
+WhipIngest::Response WhipIngest::remove(const Request& request)
+{
+    if(0 != request.query.compare(0, ResourceQuery.size(), ResourceQuery))
+        return Response(404, "Not Found");
+
+    // the same credentials as publishing requires
+    std::string user;
+    std::string password;
+    ParseCredentials(request.header("authorization"), &user, &password);
+
+    if(!authorize(user, password, request.path)) {
+        Log()->info(
+            "WhipIngest. Unauthorized stop. user: {}, path: {}",
+            user, request.path);
+        Response response(401, "Unauthorized");
+        response.headers.emplace_back("WWW-Authenticate", "Basic realm=\"WHIP\"");
+        return response;
+    }
+
+    const std::string id = request.query.substr(ResourceQuery.size());
+    {
+        std::lock_guard<std::mutex> lock(_sessionsMutex);
+        auto it = _sessions.find(id);
+        if(it == _sessions.end() || it->second->path != request.path)
+            return Response(404, "Not Found");
+        if(it->second->user != user) {
+            Log()->info(
+                "WhipIngest. Stop by other user rejected. user: {}, path: {}",
+                user, request.path);
+            return Response(403, "Forbidden");
+        }
+    }
+
+    invokeSync(
+        [this, &id] () {
+            stopSession(id);
+        });
+
+    return Response(200, "OK");
+}
+
+std::shared_ptr<WhipIngest::Session> WhipIngest::createSession(
+    const std::string& user,
+    const std::string& path,
+    int payloadType,
+    const std::shared_ptr<Channel>& channel)
+{
+    std::string id;
+    if(!RandomId(&id)) {
+        Log()->critical("WhipIngest. Fail to generate resource id");
+        return nullptr;
+    }
+
+    // the same elements chain as RTSP recorder's one,
+    // H.264 is depayloaded and pushed to channel without transcoding
+    const char* pipelineDesc =
+        "webrtcbin name=webrtc bundle-policy=max-bundle "
+        "rtph264depay name=depay ! h264parse config-interval=-1 ! "
+        "video/x-h264,stream-format=byte-stream,alignment=au ! "
+        "appsink name=channel sync=false async=false";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc, &error);
+    GErrorPtr errorPtr(error);
+    if(errorPtr) {
+        Log()->critical(
+            "Fail to create WHIP ingest pipeline: {}",
+            errorPtr->message);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return nullptr;
+    }
+
+    std::shared_ptr<Session> session =
+        std::make_shared<Session>(
+            shared_from_this(),
+            id,
+            user,
+            path);
+    session->pipeline = pipeline;
+    session->webrtc = gst_bin_get_by_name(GST_BIN(pipeline), "webrtc");
+
+    // answer accepts offered H.264 only
+    GstCapsPtr capsPtr(
+        gst_caps_new_simple(
+            "application/x-rtp",
+            "media", G_TYPE_STRING, "video",
+            "encoding-name", G_TYPE_STRING, "H264",
+            "clock-rate", G_TYPE_INT, 90000,
+            "payload", G_TYPE_INT, payloadType,
+            NULL));
+    GstWebRTCRTPTransceiver* transceiver = nullptr;
+    g_signal_emit_by_name(
+        session->webrtc, "add-transceiver",
+        GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_RECVONLY, capsPtr.get(),
+        &transceiver);
+    if(transceiver)
+        gst_object_unref(transceiver);
+
+    g_signal_connect(session->webrtc, "pad-added",
+        G_CALLBACK(
+            (void (*)(GstElement*, GstPad*, gpointer))
+            [] (GstElement*, GstPad* pad, gpointer userData) {
+                Session* session = static_cast<Session*>(userData);
+                if(GST_PAD_DIRECTION(pad) != GST_PAD_SRC)
+                    return;
+
+                GstCapsPtr capsPtr(gst_pad_get_current_caps(pad));
+                if(!capsPtr)
+                    capsPtr.reset(gst_pad_query_caps(pad, nullptr));
+                const GstStructure* structure =
+                    capsPtr && !gst_caps_is_empty(capsPtr.get()) ?
+                        gst_caps_get_structure(capsPtr.get(), 0) : nullptr;
+                const bool isH264 =
+                    structure &&
+                    0 == g_strcmp0(gst_structure_get_string(structure, "encoding-name"), "H264");
+
+                GstElementPtr depayPtr(gst_bin_get_by_name(GST_BIN(session->pipeline), "depay"));
+                GstPadPtr sinkPadPtr(gst_element_get_static_pad(depayPtr.get(), "sink"));
+                if(isH264 && !gst_pad_is_linked(sinkPadPtr.get())) {
+                    gst_pad_link(pad, sinkPadPtr.get());
+                    return;
+                }
+
+                // audio and everything else is received but dropped
+                GstElement* fakesink = gst_element_factory_make("fakesink", nullptr);
+                g_object_set(fakesink, "sync", FALSE, "async", FALSE, NULL);
+                gst_bin_add(GST_BIN(session->pipeline), fakesink);
+                gst_element_sync_state_with_parent(fakesink);
+                GstPadPtr fakePadPtr(gst_element_get_static_pad(fakesink, "sink"));
+                gst_pad_link(pad, fakePadPtr.get());
+            }),
+        session.get());
+    g_signal_connect(session->webrtc, "notify::ice-gathering-state",
+        G_CALLBACK(
+            (void (*)(GstElement*, GParamSpec*, gpointer))
+            [] (GstElement* webrtc, GParamSpec*, gpointer userData) {
+                Session* session = static_cast<Session*>(userData);
+                GstWebRTCICEGatheringState state;
+                g_object_get(webrtc, "ice-gathering-state", &state, NULL);
+                if(state != GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE)
+                    return;
+
+                std::call_once(
+                    session->iceGatheredFlag,
+                    [session] () {
+                        session->iceGathered.set_value();
+                    });
+            }),
+        session.get());
+    g_signal_connect(session->webrtc, "notify::ice-connection-state",
+        G_CALLBACK(
+            (void (*)(GstElement*, GParamSpec*, gpointer))
+            [] (GstElement* webrtc, GParamSpec*, gpointer userData) {
+                Session* session = static_cast<Session*>(userData);
+                GstWebRTCICEConnectionState state;
+                g_object_get(webrtc, "ice-connection-state", &state, NULL);
+                if(state != GST_WEBRTC_ICE_CONNECTION_STATE_FAILED &&
+                   state != GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED)
+                {
+                    return;
+                }
+
+                Log()->info("WhipIngest. Publisher disconnected. path: {}", session->path);
+                session->stop();
+            }),
+        session.get());
+
+    GstElementPtr appsinkPtr(gst_bin_get_by_name(GST_BIN(pipeline), "channel"));
+    Channel::attachAppSink(channel, appsinkPtr.get());
+
+    // lets channel ask publisher for keyframe,
+    // rtpsession translates upstream GstForceKeyUnit event to PLI/FIR
+    GstElementPtr depayPtr(gst_bin_get_by_name(GST_BIN(pipeline), "depay"));
+    std::shared_ptr<GWeakRef> depayRef(
+        new GWeakRef,
+        [] (GWeakRef* weakRef) {
+            g_weak_ref_clear(weakRef);
+            delete weakRef;
+        });
+    g_weak_ref_init(depayRef.get(), depayPtr.get());
+
+    channel->setKeyframeRequestHandler(
+        [depayRef] () {
+            GstElementPtr depayPtr(GST_ELEMENT(g_weak_ref_get(depayRef.get())));
+            if(!depayPtr)
+                return;
+
+            gst_element_send_event(
+                depayPtr.get(),
+                gst_event_new_custom(
+                    GST_EVENT_CUSTOM_UPSTREAM,
+                    gst_structure_new(
+                        "GstForceKeyUnit",
+                        "all-headers", G_TYPE_BOOLEAN, TRUE,
+                        NULL)));
+        });
+
+    // the same time domain as media pipelines to keep timestamps as is
+    Private::UseSharedClock(GST_PIPELINE(pipeline));
+
+    // nobody iterates session's bus, so everything is handled here
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(
+        bus,
+        [] (GstBus*, GstMessage* message, gpointer userData) -> GstBusSyncReply {
+            Session* session = static_cast<Session*>(userData);
+            if(GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+                GError* error = nullptr;
+                gst_message_parse_error(message, &error, nullptr);
+                GErrorPtr errorPtr(error);
+                Log()->error(
+                    "WhipIngest. Pipeline error: {}",
+                    errorPtr ? errorPtr->message : "");
+                session->stop();
+            }
+            return GST_BUS_DROP;
+        },
+        session.get(), nullptr);
+    gst_object_unref(bus);
+
+    return session;
+}
+
+// non trickle ICE: answer is returned with all local candidates
+bool WhipIngest::Negotiate(Session* session, const std::string& offer, std::string* answer)
+{
+    if(GST_STATE_CHANGE_FAILURE == gst_element_set_state(session->pipeline, GST_STATE_PLAYING))
+        return false;
+
+    GstSDPMessage* sdp = nullptr;
+    gst_sdp_message_new(&sdp);
+    gst_sdp_message_parse_buffer(
+        reinterpret_cast<const guint8*>(offer.data()), offer.size(), sdp);
+
+    GstWebRTCSessionDescription* offerDescription =
+        gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp);
+    GstPromise* promise = gst_promise_new();
+    g_signal_emit_by_name(session->webrtc, "set-remote-description", offerDescription, promise);
+    const bool offerAccepted = WaitPromise(promise);
+    gst_promise_unref(promise);
+    gst_webrtc_session_description_free(offerDescription);
+    if(!offerAccepted)
+        return false;
+
+    promise = gst_promise_new();
+    g_signal_emit_by_name(session->webrtc, "create-answer", nullptr, promise);
+    GstWebRTCSessionDescription* answerDescription = nullptr;
+    if(WaitPromise(promise)) {
+        gst_structure_get(
+            gst_promise_get_reply(promise),
+            "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answerDescription,
+            NULL);
+    }
+    gst_promise_unref(promise);
+    if(!answerDescription)
+        return false;
+
+    promise = gst_promise_new();
+    g_signal_emit_by_name(session->webrtc, "set-local-description", answerDescription, promise);
+    const bool answerAccepted = WaitPromise(promise);
+    gst_promise_unref(promise);
+    gst_webrtc_session_description_free(answerDescription);
+    if(!answerAccepted)
+        return false;
+
+    if(std::future_status::ready !=
+       session->iceGatheredFuture.wait_for(std::chrono::seconds(IceGatheringTimeout)))
+    {
+        Log()->warn(
+            "WhipIngest. ICE gathering timeout. Answering with candidates gathered so far. path: {}",
+            session->path);
+    }
+
+    GstWebRTCSessionDescription* localDescription = nullptr;
+    g_object_get(session->webrtc, "local-description", &localDescription, NULL);
+    if(!localDescription)
+        return false;
+
+    GCharPtr sdpTextPtr(gst_sdp_message_as_text(localDescription->sdp));
+    *answer = sdpTextPtr.get();
+    gst_webrtc_session_description_free(localDescription);
+
+    return true;
+}
+
+void WhipIngest::invoke(const std::function<void ()>& function)
+{
+    struct Invocation
+    {
+        std::weak_ptr<WhipIngest> self;
+        std::function<void ()> function;
+    };
+
+    g_main_context_invoke_full(
+        _context,
+        G_PRIORITY_DEFAULT,
+        [] (gpointer userData) -> gboolean {
+            Invocation* invocation = static_cast<Invocation*>(userData);
+            if(std::shared_ptr<WhipIngest> self = invocation->self.lock())
+                invocation->function();
+            return G_SOURCE_REMOVE;
+        },
+        new Invocation { shared_from_this(), function },
+        [] (gpointer userData) {
+            delete static_cast<Invocation*>(userData);
+        });
+}
+
+// waits until function is done on main context,
+// caller keeps WhipIngest alive meanwhile
+void WhipIngest::invokeSync(const std::function<void ()>& function)
+{
+    struct Invocation
+    {
+        std::function<void ()> function;
+        std::promise<void> done;
+    };
+
+    Invocation* invocation = new Invocation { function, std::promise<void>() };
+    std::future<void> done = invocation->done.get_future();
+
+    g_main_context_invoke_full(
+        _context,
+        G_PRIORITY_DEFAULT,
+        [] (gpointer userData) -> gboolean {
+            Invocation* invocation = static_cast<Invocation*>(userData);
+            invocation->function();
+            invocation->done.set_value();
+            return G_SOURCE_REMOVE;
+        },
+        invocation,
+        [] (gpointer userData) {
+            delete static_cast<Invocation*>(userData);
+        });
+
+    // broken promise makes future ready too if context is gone
+    done.wait();
+}
+
+void WhipIngest::stopSession(const std::string& id)
+{
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(_sessionsMutex);
+        auto it = _sessions.find(id);
+        if(it == _sessions.end())
+            return;
+
+        session = it->second;
+        _sessions.erase(it);
+    }
+
+    const std::string path = session->path;
+    session.reset();
+
+    Log()->info("WhipIngest. Session stopped. path: {}", path);
+
+    if(_callbacks.stopRecord)
+        _callbacks.stopRecord(path);
+}
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include <gio/gio.h>
+
+#include "Channel.h"
+
+
+namespace RestreamServerLib
+{
+
+// WHIP (WebRTC-HTTP ingestion protocol) endpoint on plain HTTP port.
+// "POST /path" with SDP offer starts publishing of path,
+// SDP answer is returned when ICE candidates are gathered (no trickle ICE)
+// together with resource url in "Location" header,
+// "DELETE" of resource url with the same credentials stops publishing.
+// Only H.264 video is taken, it's depayloaded and pushed to the channel
+// of the path the same way as RTSP recorder's one, other media are dropped.
+// Credentials are taken from "Authorization: Basic" header,
+// or from "Authorization: Bearer user:password" for clients
+// supporting bearer tokens only.
+// There is no TLS, so port should be exposed only behind TLS proxy or locally.
+// Available only if built with gstreamer-webrtc.
+class WhipIngest : public std::enable_shared_from_this<WhipIngest>
+{
+public:
+    enum {
+        MaxConnections = 16,
+        MaxRequestSize = 64 * 1024,
+        RequestTimeout = 10, // seconds
+        IceGatheringTimeout = 5, // seconds
+    };
+
+    struct Callbacks
+    {
+        // called from main context while connection thread waits for result
+        std::function<bool (
+            const std::string& user,
+            const std::string& password,
+            const std::string& path)> authorize;
+        // called from main context, returns nullptr if recording is not allowed
+        std::function<std::shared_ptr<Channel> (
+            const std::string& user,
+            const std::string& path)> startRecord;
+        std::function<void (const std::string& path)> stopRecord;
+    };
+
+    WhipIngest(const Callbacks&, unsigned short port);
+    ~WhipIngest();
+
+    bool start();
+
+private:
+    struct Request;
+    struct Response;
+    struct Session;
+
+    static bool ReadRequest(GInputStream*, Request*);
+    static void WriteResponse(GOutputStream*, const Response&);
+    static void ParseCredentials(
+        const std::string& authorization,
+        std::string* user,
+        std::string* password);
+
+    // called from connection thread
+    void handleConnection(GSocketConnection*);
+    bool authorize(
+        const std::string& user,
+        const std::string& password,
+        const std::string& path);
+    Response post(const Request&);
+    Response remove(const Request&);
+
+    std::shared_ptr<Session> createSession(
+        const std::string& user,
+        const std::string& path,
+        int payloadType,
+        const std::shared_ptr<Channel>&);
+    static bool Negotiate(Session*, const std::string& offer, std::string* answer);
+
+    void invoke(const std::function<void ()>&);
+    void invokeSync(const std::function<void ()>&);
+
+    // called from main context
+    void stopSession(const std::string& id);
+
+private:
+    const Callbacks _callbacks;
+    const unsigned short _port;
+
+    GMainContext* _context;
+
+    GSocketService* _service;
+
+    std::mutex _sessionsMutex;
+    std::map<std::string, std::shared_ptr<Session> > _sessions;
+};
+
+}
@@ -0,0 +1,177 @@
+// Several PathDirectory instances gossiping on 127.0.0.1:
+// announce/withdraw propagate to every peer, the latest announcement
+// of path wins, entries of silent node expire after ExpireHeartbeats
+// and datagrams from addresses other than peers' ones are ignored.
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include <gio/gio.h>
+
+#include "RestreamServerLib/PathDirectory.h"
+
+
+namespace
+{
+
+using namespace RestreamServerLib;
+
+enum {
+    NodesCount = 3,
+    BasePort = 47300,
+    StrangerPort = BasePort + NodesCount,
+    PropagationTimeout = 2, // seconds
+    SkipTest = 77,
+};
+
+const gint64 ExpireTime =
+    gint64(PathDirectory::HeartbeatInterval) * PathDirectory::ExpireHeartbeats * G_USEC_PER_SEC;
+
+std::string NodeUrl(unsigned node)
+{
+    return "rtsp://node" + std::to_string(node) + ":8001";
+}
+
+// iterates main context until condition is met or timeout expires
+bool WaitFor(const std::function<bool ()>& condition, gint64 timeout /* us */)
+{
+    const gint64 deadline = g_get_monotonic_time() + timeout;
+    while(!condition()) {
+        if(g_get_monotonic_time() > deadline)
+            return false;
+
+        g_main_context_iteration(nullptr, FALSE);
+        g_usleep(10 * 1000);
+    }
+
+    return true;
+}
+
+void RunFor(gint64 duration /* us */)
+{
+    WaitFor([] () { return false; }, duration);
+}
+
+bool WaitLookup(
+    const PathDirectory& directory,
+    const std::string& path,
+    const std::string& expected,
+    gint64 timeout = PropagationTimeout * G_USEC_PER_SEC)
+{
+    return
+        WaitFor(
+            [&directory, &path, &expected] () {
+                return directory.lookup(path) == expected;
+            },
+            timeout);
+}
+
+bool Check(bool condition, const char* description)
+{
+    if(!condition)
+        fprintf(stderr, "FAIL: %s\n", description);
+
+    return condition;
+}
+
+// sends gossip datagram from port nobody has as peer
+void SendFromStranger(const std::string& datagram, unsigned short port)
+{
+    GSocket* socket =
+        g_socket_new(
+            G_SOCKET_FAMILY_IPV4,
+            G_SOCKET_TYPE_DATAGRAM,
+            G_SOCKET_PROTOCOL_UDP,
+            nullptr);
+    if(!socket)
+        return;
+
+    GSocketAddress* sourceAddress = g_inet_socket_address_new_from_string("127.0.0.1", StrangerPort);
+    g_socket_bind(socket, sourceAddress, TRUE, nullptr);
+    g_object_unref(sourceAddress);
+
+    GSocketAddress* address = g_inet_socket_address_new_from_string("127.0.0.1", port);
+    g_socket_send_to(socket, address, datagram.data(), datagram.size(), nullptr, nullptr);
+    g_object_unref(address);
+
+    g_object_unref(socket);
+}
+
+}
+
+int main(int, char*[])
+{
+    std::unique_ptr<PathDirectory> nodes[NodesCount];
+    for(unsigned i = 0; i < NodesCount; ++i) {
+        nodes[i].reset(new PathDirectory(NodeUrl(i)));
+        for(unsigned peer = 0; peer < NodesCount; ++peer) {
+            if(peer != i)
+                nodes[i]->addPeer("127.0.0.1", BasePort + peer);
+        }
+
+        if(!nodes[i]->listen(BasePort + i, "127.0.0.1")) {
+            fprintf(stderr, "Port %u is not available, test skipped\n", BasePort + i);
+            return SkipTest;
+        }
+    }
+
+    PathDirectory& a = *nodes[0];
+    PathDirectory& b = *nodes[1];
+    PathDirectory& c = *nodes[2];
+
+    bool passed = true;
+
+    // announce reaches every peer
+    a.announce("/cam");
+    passed &= Check(WaitLookup(b, "/cam", NodeUrl(0) + "/cam"), "announce didn't reach node 1");
+    passed &= Check(WaitLookup(c, "/cam", NodeUrl(0) + "/cam"), "announce didn't reach node 2");
+    passed &= Check(a.lookup("/cam").empty(), "own path is redirected");
+
+    // withdraw reaches every peer
+    a.withdraw("/cam");
+    passed &= Check(WaitLookup(b, "/cam", std::string()), "withdraw didn't reach node 1");
+    passed &= Check(WaitLookup(c, "/cam", std::string()), "withdraw didn't reach node 2");
+
+    // nobody but peers is listened to
+    SendFromStranger("RSDIR1 rtsp://stranger:8001\n+/cam\n", BasePort + 1);
+    passed &=
+        Check(
+            !WaitLookup(b, "/cam", "rtsp://stranger:8001/cam", G_USEC_PER_SEC),
+            "announce of stranger accepted");
+
+    a.announce("/moved");
+    a.announce("/gone");
+    passed &= Check(WaitLookup(b, "/moved", NodeUrl(0) + "/moved"), "announce didn't reach node 1");
+    passed &= Check(WaitLookup(b, "/gone", NodeUrl(0) + "/gone"), "announce didn't reach node 1");
+
+    // node goes silent without withdrawing it's paths
+    nodes[0].reset();
+    const gint64 silenceStart = g_get_monotonic_time();
+
+    // the latest announcement wins
+    c.announce("/moved");
+    passed &=
+        Check(
+            WaitLookup(b, "/moved", NodeUrl(2) + "/moved"),
+            "the latest announcement didn't win");
+
+    // the last heartbeat of silent node was at most HeartbeatInterval ago
+    const gint64 aliveTime = ExpireTime - PathDirectory::HeartbeatInterval * G_USEC_PER_SEC;
+    RunFor(aliveTime - G_USEC_PER_SEC - (g_get_monotonic_time() - silenceStart));
+    passed &= Check(b.lookup("/gone") == NodeUrl(0) + "/gone", "path expired too early");
+
+    passed &=
+        Check(
+            WaitLookup(
+                b, "/gone", std::string(),
+                ExpireTime + G_USEC_PER_SEC - (g_get_monotonic_time() - silenceStart)),
+            "path of silent node didn't expire");
+
+    // the node still announcing keeps it's path
+    passed &= Check(b.lookup("/moved") == NodeUrl(2) + "/moved", "refreshed path expired");
+
+    return passed ? 0 : 1;
+}
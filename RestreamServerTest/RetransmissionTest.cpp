@@ -0,0 +1,347 @@
+// Loopback loss injection for recorder's uplink:
+// rtspclientsink publishes to local RTSP server with record media factory,
+// every LossInterval-th RTP packet leaving publisher's rtpbin is dropped.
+// Passes if server's jitterbuffer requested retransmissions,
+// every lost packet was recovered and every frame reached path's channel.
+
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "RestreamServerLib/Channel.h"
+#include "RestreamServerLib/RtspRecordMediaFactory.h"
+
+
+namespace
+{
+
+using namespace RestreamServerLib;
+
+enum {
+    FramesCount = 300,
+    LossInterval = 50, // packets
+    DrainTime = 2, // seconds after publisher's EOS
+    Timeout = 40, // seconds
+    SkipTest = 77,
+};
+
+struct Test
+{
+    GMainLoop* loop = nullptr;
+
+    std::shared_ptr<Channel> channel;
+    Channel::ListenerId listenerId = Channel::InvalidListener;
+    std::atomic<unsigned> receivedFrames { 0 };
+
+    // first jitterbuffer of record media
+    GstElement* jitterbuffer = nullptr;
+
+    gint payloadType = -1;
+    std::atomic<unsigned> sentPackets { 0 };
+    std::atomic<unsigned> droppedPackets { 0 };
+
+    bool publisherFailed = false;
+    bool timedOut = false;
+};
+
+bool PluginsAvailable()
+{
+    for(const char* name: { "videotestsrc", "x264enc", "rtspclientsink", "rtprtxreceive" }) {
+        GstElementFactory* factory = gst_element_factory_find(name);
+        if(!factory) {
+            fprintf(stderr, "%s is not available, test skipped\n", name);
+            return false;
+        }
+        gst_object_unref(factory);
+    }
+
+    return true;
+}
+
+GstElement* FindRtpBin(GstBin* bin)
+{
+    GstElement* rtpbin = nullptr;
+
+    GstIterator* it = gst_bin_iterate_recurse(bin);
+    GValue item = G_VALUE_INIT;
+    while(!rtpbin && GST_ITERATOR_OK == gst_iterator_next(it, &item)) {
+        GstElement* element = GST_ELEMENT(g_value_get_object(&item));
+        GstElementFactory* factory = gst_element_get_factory(element);
+        if(factory && 0 == g_strcmp0(GST_OBJECT_NAME(factory), "rtpbin"))
+            rtpbin = GST_ELEMENT(gst_object_ref(element));
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    return rtpbin;
+}
+
+// keeps the first jitterbuffer created by record media
+void MediaPrepared(GstRTSPMedia* media, Test* test)
+{
+    GstElement* element = gst_rtsp_media_get_element(media);
+    GstObject* pipeline = gst_object_get_parent(GST_OBJECT(element));
+    gst_object_unref(element);
+    if(!pipeline)
+        return;
+
+    GstElement* rtpbin = FindRtpBin(GST_BIN(pipeline));
+    gst_object_unref(pipeline);
+    if(!rtpbin)
+        return;
+
+    g_signal_connect(rtpbin, "new-jitterbuffer",
+        G_CALLBACK(
+            (void (*)(GstElement*, GstElement*, guint, guint, gpointer))
+            [] (GstElement*, GstElement* jitterbuffer, guint, guint, gpointer userData) {
+                Test* test = static_cast<Test*>(userData);
+                if(!test->jitterbuffer)
+                    test->jitterbuffer = GST_ELEMENT(gst_object_ref(jitterbuffer));
+            }),
+        test);
+    gst_object_unref(rtpbin);
+}
+
+// drops every LossInterval-th original (not retransmitted) packet
+GstPadProbeReturn DropPacket(GstPad*, GstPadProbeInfo* info, gpointer userData)
+{
+    Test* test = static_cast<Test*>(userData);
+
+    GstRTPBuffer rtpBuffer = GST_RTP_BUFFER_INIT;
+    if(!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtpBuffer))
+        return GST_PAD_PROBE_OK;
+
+    const gint payloadType = gst_rtp_buffer_get_payload_type(&rtpBuffer);
+    gst_rtp_buffer_unmap(&rtpBuffer);
+
+    if(test->payloadType < 0)
+        test->payloadType = payloadType;
+    if(payloadType != test->payloadType)
+        return GST_PAD_PROBE_OK;
+
+    if(0 == ++test->sentPackets % LossInterval) {
+        ++test->droppedPackets;
+        return GST_PAD_PROBE_DROP;
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+void NewManager(GstElement*, GstElement* rtpbin, gpointer userData)
+{
+    g_signal_connect(rtpbin, "pad-added",
+        G_CALLBACK(
+            (void (*)(GstElement*, GstPad*, gpointer))
+            [] (GstElement*, GstPad* pad, gpointer userData) {
+                if(!g_str_has_prefix(GST_PAD_NAME(pad), "send_rtp_src_"))
+                    return;
+
+                gst_pad_add_probe(
+                    pad, GST_PAD_PROBE_TYPE_BUFFER,
+                    DropPacket, userData, nullptr);
+            }),
+        userData);
+}
+
+GstElement* StartPublisher(Test* test, guint port)
+{
+    const std::string pipelineDesc =
+        "videotestsrc is-live=true num-buffers=" + std::to_string(FramesCount) + " ! "
+        "video/x-raw,width=640,height=480,framerate=30/1 ! "
+        "x264enc tune=zerolatency key-int-max=300 bitrate=2000 ! "
+        "rtspclientsink name=sink protocols=udp "
+        "location=rtsp://127.0.0.1:" + std::to_string(port) + "/test";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(pipelineDesc.c_str(), &error);
+    if(error) {
+        fprintf(stderr, "Fail to create publisher: %s\n", error->message);
+        g_error_free(error);
+        if(pipeline)
+            gst_object_unref(pipeline);
+        return nullptr;
+    }
+
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_util_set_object_arg(G_OBJECT(sink), "profiles", "avpf");
+    g_signal_connect(sink, "new-manager", G_CALLBACK(NewManager), test);
+    gst_object_unref(sink);
+
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_add_watch(
+        bus,
+        [] (GstBus*, GstMessage* message, gpointer userData) -> gboolean {
+            Test* test = static_cast<Test*>(userData);
+            switch(GST_MESSAGE_TYPE(message)) {
+            case GST_MESSAGE_ERROR: {
+                GError* error = nullptr;
+                gst_message_parse_error(message, &error, nullptr);
+                fprintf(stderr, "Publisher error: %s\n", error ? error->message : "");
+                if(error)
+                    g_error_free(error);
+                test->publisherFailed = true;
+                g_main_loop_quit(test->loop);
+                break;
+            }
+            case GST_MESSAGE_EOS:
+                // lets the last frames and retransmissions arrive
+                g_timeout_add_seconds(
+                    DrainTime,
+                    [] (gpointer userData) -> gboolean {
+                        g_main_loop_quit(static_cast<Test*>(userData)->loop);
+                        return G_SOURCE_REMOVE;
+                    },
+                    test);
+                break;
+            default:
+                break;
+            }
+            return G_SOURCE_CONTINUE;
+        },
+        test);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    return pipeline;
+}
+
+guint64 JitterbufferStat(GstElement* jitterbuffer, const char* name)
+{
+    GstStructure* stats = nullptr;
+    g_object_get(jitterbuffer, "stats", &stats, NULL);
+    if(!stats)
+        return 0;
+
+    guint64 value = 0;
+    gst_structure_get_uint64(stats, name, &value);
+    gst_structure_free(stats);
+
+    return value;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+
+#if !GST_CHECK_VERSION(1, 16, 0)
+    fprintf(stderr, "GStreamer 1.16 or newer is required, test skipped\n");
+    return SkipTest;
+#endif
+
+    if(!PluginsAvailable())
+        return SkipTest;
+
+    Test test;
+    test.loop = g_main_loop_new(nullptr, FALSE);
+
+    test.channel = std::make_shared<Channel>();
+    auto drain =
+        [&test] () {
+            while(GstSample* sample = test.channel->pull(test.listenerId)) {
+                ++test.receivedFrames;
+                gst_sample_unref(sample);
+            }
+        };
+    test.listenerId = test.channel->addListener(drain);
+    // listener is notified only after it found channel empty
+    drain();
+
+    GstRTSPServer* server = gst_rtsp_server_new();
+    gst_rtsp_server_set_address(server, "127.0.0.1");
+    gst_rtsp_server_set_service(server, "0");
+
+    RtspRecordMediaFactory* factory = rtsp_record_media_factory_new(test.channel);
+    g_signal_connect(factory, "media-constructed",
+        G_CALLBACK(
+            (void (*)(GstRTSPMediaFactory*, GstRTSPMedia*, gpointer))
+            [] (GstRTSPMediaFactory*, GstRTSPMedia* media, gpointer userData) {
+                g_signal_connect(media, "prepared", G_CALLBACK(MediaPrepared), userData);
+            }),
+        &test);
+
+    GstRTSPMountPoints* mountPoints = gst_rtsp_server_get_mount_points(server);
+    gst_rtsp_mount_points_add_factory(
+        mountPoints, "/test", GST_RTSP_MEDIA_FACTORY(factory));
+    g_object_unref(mountPoints);
+
+    gst_rtsp_server_attach(server, nullptr);
+
+    GstElement* publisher = StartPublisher(&test, gst_rtsp_server_get_bound_port(server));
+    if(!publisher)
+        return 1;
+
+    g_timeout_add_seconds(
+        Timeout,
+        [] (gpointer userData) -> gboolean {
+            Test* test = static_cast<Test*>(userData);
+            test->timedOut = true;
+            g_main_loop_quit(test->loop);
+            return G_SOURCE_REMOVE;
+        },
+        &test);
+
+    g_main_loop_run(test.loop);
+
+    const guint64 rtxRequests =
+        test.jitterbuffer ? JitterbufferStat(test.jitterbuffer, "rtx-count") : 0;
+    const guint64 rtxRecovered =
+        test.jitterbuffer ? JitterbufferStat(test.jitterbuffer, "rtx-success-count") : 0;
+    const guint64 lostPackets =
+        test.jitterbuffer ? JitterbufferStat(test.jitterbuffer, "num-lost") : 0;
+
+    gst_element_set_state(publisher, GST_STATE_NULL);
+    gst_object_unref(publisher);
+
+    test.channel->removeListener(test.listenerId);
+
+    printf(
+        "sent packets: %u, dropped: %u, retransmission requests: %" G_GUINT64_FORMAT
+        ", recovered: %" G_GUINT64_FORMAT ", lost: %" G_GUINT64_FORMAT
+        ", frames: %u of %u\n",
+        test.sentPackets.load(), test.droppedPackets.load(),
+        rtxRequests, rtxRecovered, lostPackets,
+        test.receivedFrames.load(), static_cast<unsigned>(FramesCount));
+
+    bool passed = true;
+    if(test.publisherFailed || test.timedOut) {
+        fprintf(stderr, "FAIL: publisher didn't finish\n");
+        passed = false;
+    }
+    if(!test.jitterbuffer) {
+        fprintf(stderr, "FAIL: record media jitterbuffer not found\n");
+        passed = false;
+    }
+    if(test.droppedPackets == 0) {
+        fprintf(stderr, "FAIL: no packets were dropped\n");
+        passed = false;
+    }
+    if(rtxRequests == 0) {
+        fprintf(stderr, "FAIL: no retransmissions were requested\n");
+        passed = false;
+    }
+    if(rtxRecovered == 0 || lostPackets != 0) {
+        fprintf(stderr, "FAIL: lost packets were not recovered\n");
+        passed = false;
+    }
+    if(test.receivedFrames != FramesCount) {
+        fprintf(stderr, "FAIL: not every frame reached channel\n");
+        passed = false;
+    }
+
+    if(test.jitterbuffer)
+        gst_object_unref(test.jitterbuffer);
+    g_object_unref(server);
+    g_main_loop_unref(test.loop);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,422 @@
+// Local webrtcbin publisher against WHIP listener:
+// offer is POSTed with publisher's credentials, answer is applied
+// and published frames have to reach path's channel.
+// Then resource is DELETEd without credentials (401 expected),
+// with credentials of other authorized user (403 expected)
+// and with publisher's credentials (200 expected, recording stops).
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+#include "RestreamServerLib/Channel.h"
+#include "RestreamServerLib/WhipIngest.h"
+
+
+namespace
+{
+
+using namespace RestreamServerLib;
+
+enum {
+    Port = 47380,
+    FramesCount = 30,
+    StepTimeout = 10, // seconds
+    Timeout = 40, // seconds
+    SkipTest = 77,
+};
+
+const char* Path = "/whip";
+
+const char* Publisher = "publisher:secret";
+const char* OtherUser = "other:secret";
+
+struct Test
+{
+    GMainLoop* loop = nullptr;
+
+    std::shared_ptr<Channel> channel;
+    Channel::ListenerId listenerId = Channel::InvalidListener;
+    std::atomic<unsigned> receivedFrames { 0 };
+
+    std::atomic<unsigned> recordsStarted { 0 };
+    std::atomic<unsigned> recordsStopped { 0 };
+
+    GstElement* webrtc = nullptr;
+
+    unsigned postStatus = 0;
+    unsigned anonymousDeleteStatus = 0;
+    unsigned otherUserDeleteStatus = 0;
+    unsigned publisherDeleteStatus = 0;
+    bool framesTimedOut = false;
+    bool timedOut = false;
+};
+
+struct Response
+{
+    unsigned status = 0;
+    std::string location;
+    std::string body;
+};
+
+bool PluginsAvailable()
+{
+    for(const char* name: { "videotestsrc", "x264enc", "rtph264pay", "webrtcbin", "nicesrc" }) {
+        GstElementFactory* factory = gst_element_factory_find(name);
+        if(!factory) {
+            fprintf(stderr, "%s is not available, test skipped\n", name);
+            return false;
+        }
+        gst_object_unref(factory);
+    }
+
+    return true;
+}
+
+// the only accepted credentials are Publisher and OtherUser
+bool Authorize(const std::string& user, const std::string& password, const std::string& path)
+{
+    const std::string credentials = user + ":" + password;
+    return path == Path && (credentials == Publisher || credentials == OtherUser);
+}
+
+// one request per connection, as WHIP listener closes it after response
+Response HttpRequest(
+    const std::string& method,
+    const std::string& target,
+    const char* credentials,
+    const std::string& body)
+{
+    Response response;
+
+    GSocketClient* client = g_socket_client_new();
+    g_socket_client_set_timeout(client, StepTimeout);
+    GSocketConnection* connection =
+        g_socket_client_connect_to_host(client, "127.0.0.1", Port, nullptr, nullptr);
+    g_object_unref(client);
+    if(!connection)
+        return response;
+
+    std::string request = method + " " + target + " HTTP/1.1\r\n";
+    request += "Host: 127.0.0.1\r\n";
+    if(credentials) {
+        gchar* encoded =
+            g_base64_encode(reinterpret_cast<const guchar*>(credentials), strlen(credentials));
+        request += std::string("Authorization: Basic ") + encoded + "\r\n";
+        g_free(encoded);
+    }
+    if(!body.empty())
+        request += "Content-Type: application/sdp\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    request += body;
+
+    g_output_stream_write_all(
+        g_io_stream_get_output_stream(G_IO_STREAM(connection)),
+        request.data(), request.size(), nullptr, nullptr, nullptr);
+
+    std::string data;
+    char buffer[4096];
+    gssize size;
+    while((size = g_input_stream_read(
+        g_io_stream_get_input_stream(G_IO_STREAM(connection)),
+        buffer, sizeof(buffer), nullptr, nullptr)) > 0)
+    {
+        data.append(buffer, size);
+    }
+
+    g_io_stream_close(G_IO_STREAM(connection), nullptr, nullptr);
+    g_object_unref(connection);
+
+    // HTTP/1.1 <status> <reason>
+    const std::string::size_type statusStart = data.find(' ');
+    if(statusStart == std::string::npos)
+        return response;
+    response.status = g_ascii_strtoull(data.c_str() + statusStart + 1, nullptr, 10);
+
+    const std::string::size_type headersEnd = data.find("\r\n\r\n");
+    if(headersEnd == std::string::npos)
+        return response;
+    response.body = data.substr(headersEnd + 4);
+
+    const std::string locationHeader = "\r\nLocation: ";
+    const std::string::size_type locationStart = data.find(locationHeader);
+    if(locationStart != std::string::npos && locationStart < headersEnd) {
+        const std::string::size_type valueStart = locationStart + locationHeader.size();
+        response.location = data.substr(valueStart, data.find("\r\n", valueStart) - valueStart);
+    }
+
+    return response;
+}
+
+GstWebRTCSessionDescription* CreateOffer(GstElement* webrtc)
+{
+    GstPromise* promise = gst_promise_new();
+    g_signal_emit_by_name(webrtc, "create-offer", nullptr, promise);
+    GstWebRTCSessionDescription* offer = nullptr;
+    if(GST_PROMISE_RESULT_REPLIED == gst_promise_wait(promise)) {
+        const GstStructure* reply = gst_promise_get_reply(promise);
+        if(reply)
+            gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    }
+    gst_promise_unref(promise);
+
+    return offer;
+}
+
+void SetDescription(GstElement* webrtc, const char* signal, GstWebRTCSessionDescription* description)
+{
+    GstPromise* promise = gst_promise_new();
+    g_signal_emit_by_name(webrtc, signal, description, promise);
+    gst_promise_wait(promise);
+    gst_promise_unref(promise);
+}
+
+// without trickle ICE offer has to carry all candidates
+bool WaitIceGathering(GstElement* webrtc)
+{
+    const gint64 deadline = g_get_monotonic_time() + StepTimeout * G_USEC_PER_SEC;
+    for(;;) {
+        GstWebRTCICEGatheringState state = GST_WEBRTC_ICE_GATHERING_STATE_NEW;
+        g_object_get(webrtc, "ice-gathering-state", &state, NULL);
+        if(GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE == state)
+            return true;
+        if(g_get_monotonic_time() > deadline)
+            return false;
+        g_usleep(50 * 1000);
+    }
+}
+
+std::string LocalSdp(GstElement* webrtc)
+{
+    GstWebRTCSessionDescription* description = nullptr;
+    g_object_get(webrtc, "local-description", &description, NULL);
+    if(!description)
+        return std::string();
+
+    gchar* sdp = gst_sdp_message_as_text(description->sdp);
+    const std::string sdpText = sdp;
+    g_free(sdp);
+    gst_webrtc_session_description_free(description);
+
+    return sdpText;
+}
+
+bool ApplyAnswer(GstElement* webrtc, const std::string& answerText)
+{
+    GstSDPMessage* sdp = nullptr;
+    gst_sdp_message_new(&sdp);
+    if(GST_SDP_OK != gst_sdp_message_parse_buffer(
+        reinterpret_cast<const guint8*>(answerText.data()), answerText.size(), sdp))
+    {
+        gst_sdp_message_free(sdp);
+        return false;
+    }
+
+    GstWebRTCSessionDescription* answer =
+        gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdp);
+    SetDescription(webrtc, "set-remote-description", answer);
+    gst_webrtc_session_description_free(answer);
+
+    return true;
+}
+
+bool WaitFrames(Test* test)
+{
+    const gint64 deadline = g_get_monotonic_time() + StepTimeout * G_USEC_PER_SEC;
+    while(test->receivedFrames < FramesCount) {
+        if(g_get_monotonic_time() > deadline)
+            return false;
+        g_usleep(50 * 1000);
+    }
+
+    return true;
+}
+
+// runs outside of main context since WHIP listener
+// needs main context to handle requests
+void Publish(Test* test)
+{
+    do {
+        GstWebRTCSessionDescription* offer = CreateOffer(test->webrtc);
+        if(!offer) {
+            fprintf(stderr, "Fail to create offer\n");
+            break;
+        }
+        SetDescription(test->webrtc, "set-local-description", offer);
+        gst_webrtc_session_description_free(offer);
+
+        if(!WaitIceGathering(test->webrtc)) {
+            fprintf(stderr, "ICE gathering didn't complete\n");
+            break;
+        }
+
+        const Response postResponse =
+            HttpRequest("POST", Path, Publisher, LocalSdp(test->webrtc));
+        test->postStatus = postResponse.status;
+        if(postResponse.status != 201 || postResponse.location.empty()) {
+            fprintf(stderr, "POST failed with status %u\n", postResponse.status);
+            break;
+        }
+
+        if(!ApplyAnswer(test->webrtc, postResponse.body)) {
+            fprintf(stderr, "Invalid answer\n");
+            break;
+        }
+
+        test->framesTimedOut = !WaitFrames(test);
+
+        const std::string& resource = postResponse.location;
+        test->anonymousDeleteStatus =
+            HttpRequest("DELETE", resource, nullptr, std::string()).status;
+        test->otherUserDeleteStatus =
+            HttpRequest("DELETE", resource, OtherUser, std::string()).status;
+        test->publisherDeleteStatus =
+            HttpRequest("DELETE", resource, Publisher, std::string()).status;
+    } while(false);
+
+    g_main_context_invoke(
+        nullptr,
+        [] (gpointer userData) -> gboolean {
+            g_main_loop_quit(static_cast<Test*>(userData)->loop);
+            return G_SOURCE_REMOVE;
+        },
+        test);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+
+    if(!PluginsAvailable())
+        return SkipTest;
+
+    Test test;
+    test.loop = g_main_loop_new(nullptr, FALSE);
+
+    test.channel = std::make_shared<Channel>();
+    auto drain =
+        [&test] () {
+            while(GstSample* sample = test.channel->pull(test.listenerId)) {
+                ++test.receivedFrames;
+                gst_sample_unref(sample);
+            }
+        };
+    test.listenerId = test.channel->addListener(drain);
+    // listener is notified only after it found channel empty
+    drain();
+
+    WhipIngest::Callbacks callbacks;
+    callbacks.authorize = Authorize;
+    callbacks.startRecord =
+        [&test] (const std::string&, const std::string&) -> std::shared_ptr<Channel> {
+            ++test.recordsStarted;
+            return test.channel;
+        };
+    callbacks.stopRecord =
+        [&test] (const std::string&) {
+            ++test.recordsStopped;
+        };
+
+    std::shared_ptr<WhipIngest> whipIngest = std::make_shared<WhipIngest>(callbacks, Port);
+    if(!whipIngest->start()) {
+        fprintf(stderr, "Port %u is not available, test skipped\n", static_cast<unsigned>(Port));
+        return SkipTest;
+    }
+
+    GError* error = nullptr;
+    GstElement* publisher =
+        gst_parse_launch(
+            "videotestsrc is-live=true ! "
+            "video/x-raw,width=320,height=240,framerate=30/1 ! "
+            "x264enc tune=zerolatency key-int-max=30 ! "
+            "rtph264pay config-interval=-1 pt=96 ! "
+            "application/x-rtp,media=video,encoding-name=H264,payload=96,clock-rate=90000 ! "
+            "webrtcbin name=webrtc bundle-policy=max-bundle",
+            &error);
+    if(error) {
+        fprintf(stderr, "Fail to create publisher: %s\n", error->message);
+        g_error_free(error);
+        if(publisher)
+            gst_object_unref(publisher);
+        return 1;
+    }
+
+    test.webrtc = gst_bin_get_by_name(GST_BIN(publisher), "webrtc");
+    gst_element_set_state(publisher, GST_STATE_PLAYING);
+
+    g_timeout_add_seconds(
+        Timeout,
+        [] (gpointer userData) -> gboolean {
+            Test* test = static_cast<Test*>(userData);
+            test->timedOut = true;
+            g_main_loop_quit(test->loop);
+            return G_SOURCE_REMOVE;
+        },
+        &test);
+
+    std::thread publishThread(Publish, &test);
+
+    g_main_loop_run(test.loop);
+
+    if(test.timedOut) {
+        // publishing thread is stuck, so it's not joined
+        fprintf(stderr, "FAIL: test timed out\n");
+        publishThread.detach();
+        return 1;
+    }
+    publishThread.join();
+
+    gst_element_set_state(publisher, GST_STATE_NULL);
+    gst_object_unref(test.webrtc);
+    gst_object_unref(publisher);
+
+    printf(
+        "POST: %u, frames: %u, DELETE without credentials: %u, "
+        "by other user: %u, by publisher: %u, records started: %u, stopped: %u\n",
+        test.postStatus, test.receivedFrames.load(),
+        test.anonymousDeleteStatus, test.otherUserDeleteStatus, test.publisherDeleteStatus,
+        test.recordsStarted.load(), test.recordsStopped.load());
+
+    bool passed = true;
+    if(test.postStatus != 201) {
+        fprintf(stderr, "FAIL: offer was not accepted\n");
+        passed = false;
+    }
+    if(test.framesTimedOut || test.receivedFrames < FramesCount) {
+        fprintf(stderr, "FAIL: frames didn't reach channel\n");
+        passed = false;
+    }
+    if(test.anonymousDeleteStatus != 401) {
+        fprintf(stderr, "FAIL: DELETE without credentials was not rejected with 401\n");
+        passed = false;
+    }
+    if(test.otherUserDeleteStatus != 403) {
+        fprintf(stderr, "FAIL: DELETE by other user was not rejected with 403\n");
+        passed = false;
+    }
+    if(test.publisherDeleteStatus != 200) {
+        fprintf(stderr, "FAIL: DELETE by publisher was not accepted\n");
+        passed = false;
+    }
+    if(test.recordsStarted != 1 || test.recordsStopped != 1) {
+        fprintf(stderr, "FAIL: recording was not started and stopped exactly once\n");
+        passed = false;
+    }
+
+    test.channel->removeListener(test.listenerId);
+    whipIngest.reset();
+    g_main_loop_unref(test.loop);
+
+    return passed ? 0 : 1;
+}